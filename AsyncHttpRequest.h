@@ -0,0 +1,381 @@
+#pragma once
+
+#include <ESP8266HTTPClient.h>
+#include <WiFiClient.h>
+
+#include "HttpConnection.h"
+#include "HttpBodyStream.h"
+
+// Maximum time spent in a single poll() call, in milliseconds.
+#ifndef ASYNC_HTTP_POLL_TIME
+#define ASYNC_HTTP_POLL_TIME 2
+#endif
+
+// A body of unknown length, like a chunked one, is considered received once no more data arrived
+// for that many milliseconds.
+#ifndef ASYNC_HTTP_SETTLE_TIME
+#define ASYNC_HTTP_SETTLE_TIME 20
+#endif
+
+// Once that many bytes of the body are received, the rest is read while parsing it. The lwIP
+// receive window is the upper bound of what can be waited for without reading.
+#ifndef ASYNC_HTTP_MAX_BUFFERED
+#define ASYNC_HTTP_MAX_BUFFERED 2048
+#endif
+
+#define ASYNC_HTTP_IDLE 0
+#define ASYNC_HTTP_SENDING 1
+#define ASYNC_HTTP_WAITING 2
+#define ASYNC_HTTP_RECEIVING 3
+#define ASYNC_HTTP_DONE 4
+
+/*
+ * HTTP request that doesn't block the loop while waiting for the server.
+ *
+ * The request moves through the sending, waiting and receiving stages on successive poll() calls,
+ * each call taking up to ASYNC_HTTP_POLL_TIME milliseconds. The response status line and the
+ * headers are parsed as they arrive. The body is left in the connection until it is received
+ * completely, so it can be parsed from getBody() without waiting. The request goes over the
+ * HttpConnection, so the keep-alive connection is reused. The request holds the connection from
+ * start() till end().
+ *
+ * Only the connect, when there is no open connection, blocks - the ESP8266 WiFiClient has no
+ * asynchronous connect. The longest poll() and start() calls are measured as the loop stall.
+ */
+class AsyncHttpRequest {
+    public:
+        void begin(HttpConnection* connection) {
+            _connection = connection;
+        }
+
+        // Connect and send the request line and the headers. The uri and the body are not copied,
+        // they must stay valid until the request is done. Returns false if the connection fails,
+        // or with the HTTP_CONNECTION_BUSY status code if another request has the connection.
+        bool start(const char* address, const char* method, const char* uri, const char* body=NULL, size_t size=0) {
+            unsigned long startedAt = millis();
+            reset();
+            if (!_connection->lock(this)) {
+                _statusCode = HTTP_CONNECTION_BUSY;
+                return false;
+            }
+
+            _address = address;
+            _method = method;
+            _uri = uri;
+            _requestBody = body;
+            _requestSize = size;
+            if (!sendRequest() && !retry()) {
+                _connection->failed();
+                _connection->unlock(this);
+                return false;
+            }
+
+            _requests++;
+            _startedAt = millis();
+            recordStall(startedAt);
+            return true;
+        }
+
+        // Move the request forward. Returns true once the request is done, successfully or not.
+        bool poll() {
+            if (_state == ASYNC_HTTP_IDLE || _state == ASYNC_HTTP_DONE) {
+                return true;
+            }
+
+            unsigned long startedAt = millis();
+            while (_state != ASYNC_HTTP_DONE && millis() - startedAt < ASYNC_HTTP_POLL_TIME) {
+                bool progress;
+                if (_state == ASYNC_HTTP_SENDING) {
+                    progress = send();
+                } else if (_state == ASYNC_HTTP_WAITING) {
+                    progress = receiveHeaders();
+                } else {
+                    progress = receiveBody();
+                }
+
+                if (progress) {
+                    _progressAt = millis();
+                } else {
+                    checkConnection();
+                    break;
+                }
+            }
+            recordStall(startedAt);
+            return _state == ASYNC_HTTP_DONE;
+        }
+
+        // Poll until the request is done, for the callers that need the response right away.
+        void complete() {
+            while (!poll()) {
+                yield();
+            }
+        }
+
+        // True from start() till end().
+        bool isBusy() {
+            return _state != ASYNC_HTTP_IDLE;
+        }
+
+        // The response status code, or a negative HTTPC_ERROR_* code on failure.
+        int getStatusCode() {
+            return _statusCode;
+        }
+
+        // The value of the Date header, empty if there was none.
+        const char* getDate() {
+            return _date;
+        }
+
+        // The body of the response, once done.
+        HttpBodyStream getBody() {
+            return HttpBodyStream(_client, _contentLength, _chunked, HTTP_CONNECTION_TIMEOUT);
+        }
+
+        // Finish the request and release the connection. It is kept open if the whole response
+        // was read and the server allows it.
+        void end(bool reusable) {
+            if (_state != ASYNC_HTTP_IDLE) {
+                if (!reusable || _statusCode < 0) {
+                    _connection->failed();
+                } else if (_close) {
+                    _connection->stop();
+                }
+            }
+            _state = ASYNC_HTTP_IDLE;
+            _connection->unlock(this);
+        }
+
+        // The longest time spent in a single start() or poll() call, in milliseconds.
+        unsigned long getMaxStall() {
+            return _maxStall;
+        }
+
+        void getStatus(char* buffer, size_t size) {
+            snprintf(
+                buffer,
+                size,
+                "%lu requests, %lu retried, %lums max stall, %lums max response",
+                (unsigned long)_requests,
+                (unsigned long)_retries,
+                _maxStall,
+                _maxResponse);
+        }
+
+    private:
+        // Connect and send the request line and the headers.
+        bool sendRequest() {
+            _client = _connection->connect(_address);
+            if (_client == NULL) {
+                _statusCode = HTTPC_ERROR_CONNECTION_FAILED;
+                return false;
+            }
+
+            _connection->writeRequest(_method, _uri);
+            if (_requestBody != NULL) {
+                char headers[64];
+                snprintf(
+                    headers,
+                    sizeof(headers),
+                    "Content-Type: text/plain\r\n"
+                    "Content-Length: %u\r\n",
+                    (unsigned int)_requestSize);
+                _client->print(headers);
+            }
+            if (_client->print("\r\n") != 2) {
+                _statusCode = HTTPC_ERROR_SEND_HEADER_FAILED;
+                return false;
+            }
+
+            _body = _requestBody;
+            _bodySize = _requestSize;
+            _state = _bodySize > 0 ? ASYNC_HTTP_SENDING : ASYNC_HTTP_WAITING;
+            _progressAt = millis();
+            return true;
+        }
+
+        // Send the request again on a new connection, once, if it failed on a reused connection
+        // before any of the response was received. See HttpConnection::connect().
+        bool retry() {
+            if (_retried || !_connection->isReused() || !_statusLine || _lineLength > 0) {
+                return false;
+            }
+            _retried = true;
+            _retries++;
+            _connection->stale();
+            return sendRequest();
+        }
+
+        void reset() {
+            _state = ASYNC_HTTP_IDLE;
+            _statusCode = HTTPC_ERROR_READ_TIMEOUT;
+            _contentLength = -1;
+            _chunked = false;
+            _close = false;
+            _date[0] = '\0';
+            _line[0] = '\0';
+            _lineLength = 0;
+            _statusLine = true;
+            _lastAvailable = 0;
+            _retried = false;
+        }
+
+        // Write as much of the body as fits in the send buffer.
+        bool send() {
+            size_t size = min(_bodySize, (size_t)_client->availableForWrite());
+            if (size == 0) {
+                return false;
+            }
+            size_t written = _client->write((const uint8_t*)_body, size);
+            _body += written;
+            _bodySize -= written;
+            if (_bodySize == 0) {
+                _state = ASYNC_HTTP_WAITING;
+            }
+            return written > 0;
+        }
+
+        // Read the status line and the headers, as much as is received.
+        bool receiveHeaders() {
+            bool progress = false;
+            while (_state == ASYNC_HTTP_WAITING && _client->available() > 0) {
+                int c = _client->read();
+                if (c < 0) {
+                    break;
+                }
+                progress = true;
+                if (c == '\r') {
+                    continue;
+                }
+                if (c != '\n') {
+                    // Long lines are truncated, none of the used headers is that long.
+                    if (_lineLength < sizeof(_line) - 1) {
+                        _line[_lineLength++] = c;
+                    }
+                    continue;
+                }
+
+                _line[_lineLength] = '\0';
+                processLine();
+                _lineLength = 0;
+            }
+            return progress;
+        }
+
+        void processLine() {
+            if (_statusLine) {
+                _statusLine = false;
+                _statusCode = strncmp(_line, "HTTP/1.", 7) == 0 && _lineLength > 9 ?
+                    atoi(_line + 9) : HTTPC_ERROR_CONNECTION_LOST;
+                if (_statusCode < 0) {
+                    finish();
+                }
+            } else if (_lineLength == 0) {
+                // End of the headers.
+                bool noBody = _statusCode == 204 || _statusCode == 304 || _contentLength == 0;
+                if (noBody) {
+                    _contentLength = 0;
+                    finish();
+                } else {
+                    _state = ASYNC_HTTP_RECEIVING;
+                }
+            } else if (strncasecmp(_line, "content-length:", 15) == 0) {
+                _contentLength = atoi(_line + 15);
+            } else if (strncasecmp(_line, "transfer-encoding:", 18) == 0) {
+                _chunked = strstr(_line + 18, "chunked") != NULL;
+            } else if (strncasecmp(_line, "connection:", 11) == 0) {
+                _close = strstr(_line + 11, "close") != NULL;
+            } else if (strncasecmp(_line, "date: ", 6) == 0) {
+                strlcpy(_date, _line + 6, sizeof(_date));
+            }
+        }
+
+        // Wait until the body is in the receive buffer.
+        bool receiveBody() {
+            int available = _client->available();
+            if ((!_chunked && _contentLength >= 0 && available >= _contentLength) ||
+                available >= ASYNC_HTTP_MAX_BUFFERED) {
+                finish();
+                return true;
+            }
+            if (available != _lastAvailable) {
+                _lastAvailable = available;
+                return true;
+            }
+            if (available > 0 && (_chunked || _contentLength < 0) &&
+                millis() - _progressAt > ASYNC_HTTP_SETTLE_TIME) {
+                finish();
+                return true;
+            }
+            return false;
+        }
+
+        // Fail the request on timeout or if the server closed the connection.
+        void checkConnection() {
+            if (_client->available() > 0) {
+                if (millis() - _progressAt > HTTP_CONNECTION_TIMEOUT) {
+                    _statusCode = HTTPC_ERROR_READ_TIMEOUT;
+                    finish();
+                }
+                return;
+            }
+
+            if (!_client->connected()) {
+                if (_state == ASYNC_HTTP_RECEIVING && !_chunked && _contentLength < 0) {
+                    // The body ends with the connection.
+                    _close = true;
+                } else if (retry()) {
+                    return;
+                } else {
+                    _statusCode = _state == ASYNC_HTTP_SENDING ?
+                        HTTPC_ERROR_SEND_PAYLOAD_FAILED : HTTPC_ERROR_CONNECTION_LOST;
+                }
+                finish();
+            } else if (millis() - _progressAt > HTTP_CONNECTION_TIMEOUT) {
+                _statusCode = HTTPC_ERROR_READ_TIMEOUT;
+                finish();
+            }
+        }
+
+        void finish() {
+            _state = ASYNC_HTTP_DONE;
+            _maxResponse = max(_maxResponse, millis() - _startedAt);
+        }
+
+        void recordStall(unsigned long startedAt) {
+            _maxStall = max(_maxStall, millis() - startedAt);
+        }
+
+        HttpConnection* _connection = NULL;
+        WiFiClient* _client = NULL;
+        uint8_t _state = ASYNC_HTTP_IDLE;
+
+        // The request, kept for a retry.
+        const char* _address = NULL;
+        const char* _method = NULL;
+        const char* _uri = NULL;
+        const char* _requestBody = NULL;
+        size_t _requestSize = 0;
+        bool _retried = false;
+
+        // The rest of the body to send.
+        const char* _body = NULL;
+        size_t _bodySize = 0;
+
+        // The response.
+        int _statusCode = HTTPC_ERROR_READ_TIMEOUT;
+        int _contentLength = -1;
+        bool _chunked = false;
+        bool _close = false;
+        char _date[32] = "";
+        char _line[64];
+        uint8_t _lineLength = 0;
+        bool _statusLine = true;
+        int _lastAvailable = 0;
+
+        unsigned long _startedAt = 0;
+        unsigned long _progressAt = 0;
+        uint32_t _requests = 0;
+        uint32_t _retries = 0;
+        unsigned long _maxStall = 0;
+        unsigned long _maxResponse = 0;
+};
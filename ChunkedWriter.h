@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Arduino.h"
+#include <Client.h>
+
+/*
+ * HTTP/1.1 chunked transfer encoding writer.
+ *
+ * Each write() is sent as a separate chunk directly to the client, so the body doesn't have to be
+ * kept in memory. Call finish() to send the terminating zero-length chunk.
+ */
+class ChunkedWriter : public Print {
+    public:
+        ChunkedWriter(Client* client) {
+            _client = client;
+        }
+
+        size_t write(uint8_t data) override {
+            return write(&data, 1);
+        }
+
+        size_t write(const uint8_t *buffer, size_t size) override {
+            if (size == 0 || _failed) {
+                return 0;
+            }
+
+            char header[12];
+            int headerSize = snprintf(header, sizeof(header), "%X\r\n", (unsigned int)size);
+            if (_client->write((const uint8_t*)header, headerSize) != (size_t)headerSize ||
+                _client->write(buffer, size) != size ||
+                _client->write((const uint8_t*)"\r\n", 2) != 2) {
+                _failed = true;
+                return 0;
+            }
+
+            _bytesWritten += size;
+            return size;
+        }
+
+        bool finish() {
+            if (!_failed && _client->write((const uint8_t*)"0\r\n\r\n", 5) != 5) {
+                _failed = true;
+            }
+            return !_failed;
+        }
+
+        bool failed() {
+            return _failed;
+        }
+
+        // Body bytes written, without the chunk framing.
+        size_t bytesWritten() {
+            return _bytesWritten;
+        }
+
+    private:
+        Client* _client;
+        size_t _bytesWritten = 0;
+        bool _failed = false;
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+#include "Arduino.h"
+#include <WiFiUdp.h>
+
+// Time between syncs until the drift is measured, in milliseconds.
+#ifndef CLOCK_SYNC_INTERVAL
+#define CLOCK_SYNC_INTERVAL 24 * 60 * 60 * 1000UL
+#endif
+
+// Time between syncs once the drift is measured, in milliseconds. Should be well below the
+// millis() rollover period of ~50 days.
+#ifndef CLOCK_CALIBRATED_SYNC_INTERVAL
+#define CLOCK_CALIBRATED_SYNC_INTERVAL 7 * 24 * 60 * 60 * 1000UL
+#endif
+
+// Maximum error of a drift measurement, in ppm. The drift is measured between two syncs only if
+// they are far enough apart for their accuracy to give that error.
+#ifndef CLOCK_MAX_DRIFT_ERROR
+#define CLOCK_MAX_DRIFT_ERROR 20
+#endif
+
+// Crystal drift assumed before it is measured, in ppm.
+#ifndef CLOCK_UNCALIBRATED_DRIFT_ERROR
+#define CLOCK_UNCALIBRATED_DRIFT_ERROR 100
+#endif
+
+// Timeout for the SNTP response, in milliseconds.
+#ifndef CLOCK_NTP_TIMEOUT
+#define CLOCK_NTP_TIMEOUT 1000
+#endif
+
+#define CLOCK_NTP_PORT 123
+#define CLOCK_NTP_PACKET_SIZE 48
+// Seconds between the NTP epoch (1900) and the Unix epoch (1970).
+#define CLOCK_NTP_UNIX_OFFSET 2208988800UL
+
+/*
+ * Wall clock based on millis(), corrected with the measured crystal drift.
+ *
+ * Each sync sets the time along with its accuracy. The drift is measured between syncs that are
+ * far enough apart, so it can be measured even with the one second resolution of the HTTP Date
+ * header - it just takes longer. A sync that is less accurate than the current estimate is used
+ * for the drift measurement only. Once the drift is known, the clock needs syncing much more rarely.
+ */
+class DriftClock {
+    public:
+        // Set the current time, as milliseconds since the Unix epoch, with the specified accuracy
+        // in milliseconds.
+        void sync(uint64_t time, uint32_t accuracy) {
+            unsigned long now = millis();
+
+            if (!_set) {
+                _set = true;
+                setBase(time, accuracy, now);
+                _calibrationTime = time;
+                _calibrationMillis = now;
+                _calibrationAccuracy = accuracy;
+                return;
+            }
+
+            // Measure the drift against the calibration reference.
+            unsigned long elapsed = now - _calibrationMillis;
+            if (elapsed > 0 && (_calibrationAccuracy + accuracy) * 1000000.0f / elapsed <= CLOCK_MAX_DRIFT_ERROR) {
+                float drift = ((int64_t)(time - _calibrationTime) - (int64_t)elapsed) * 1000000.0f / elapsed;
+                if (fabsf(drift) < 1000) {
+                    _drift = _calibrated ? (_drift + drift) / 2 : drift;
+                    _calibrated = true;
+                }
+                _calibrationTime = time;
+                _calibrationMillis = now;
+                _calibrationAccuracy = accuracy;
+            } else if (accuracy < _calibrationAccuracy) {
+                // Too close for a drift measurement, but a better reference for the next one.
+                _calibrationTime = time;
+                _calibrationMillis = now;
+                _calibrationAccuracy = accuracy;
+            }
+
+            if (accuracy <= getError()) {
+                setBase(time, accuracy, now);
+            }
+        }
+
+        // Sync with a SNTP server. Blocks for up to CLOCK_NTP_TIMEOUT milliseconds.
+        bool syncNtp(const char* server) {
+            WiFiUDP udp;
+            if (!udp.begin(CLOCK_NTP_PORT)) {
+                return false;
+            }
+
+            // Version 4, client mode. All other fields are 0 for a SNTP request.
+            uint8_t packet[CLOCK_NTP_PACKET_SIZE] = {0x23};
+            unsigned long sent = millis();
+            if (!udp.beginPacket(server, CLOCK_NTP_PORT) ||
+                udp.write(packet, sizeof(packet)) != sizeof(packet) ||
+                !udp.endPacket()) {
+                udp.stop();
+                return false;
+            }
+
+            while (millis() - sent < CLOCK_NTP_TIMEOUT) {
+                if (udp.parsePacket() < CLOCK_NTP_PACKET_SIZE) {
+                    delay(1);
+                    continue;
+                }
+
+                unsigned long roundTrip = millis() - sent;
+                udp.read(packet, sizeof(packet));
+                udp.stop();
+
+                // Server mode and non-zero stratum, stratum 0 is a kiss-o'-death response.
+                if ((packet[0] & 0x07) != 4 || packet[1] == 0) {
+                    return false;
+                }
+
+                // Transmit timestamp - seconds and fraction of a second since 1900.
+                uint32_t seconds = readUint32(packet + 40);
+                uint32_t fraction = readUint32(packet + 44);
+                uint64_t time = (uint64_t)(seconds - CLOCK_NTP_UNIX_OFFSET) * 1000 + (((uint64_t)fraction * 1000) >> 32);
+
+                // The response was sent somewhere during the round trip, assume the middle.
+                sync(time + roundTrip / 2, roundTrip / 2 + 1);
+                return true;
+            }
+
+            udp.stop();
+            return false;
+        }
+
+        bool isSet() {
+            return _set;
+        }
+
+        // True if the time for the next sync has come.
+        bool needsSync() {
+            unsigned long interval = _calibrated ? CLOCK_CALIBRATED_SYNC_INTERVAL : CLOCK_SYNC_INTERVAL;
+            return !_set || millis() - _baseMillis > interval;
+        }
+
+        // Milliseconds since the Unix epoch.
+        uint64_t nowMillis() {
+            unsigned long elapsed = millis() - _baseMillis;
+            return _baseTime + elapsed + (int64_t)(elapsed * _drift / 1000000.0f);
+        }
+
+        // Seconds since the Unix epoch.
+        uint32_t now() {
+            return nowMillis() / 1000;
+        }
+
+        // Estimated error of the current time, in milliseconds.
+        uint32_t getError() {
+            unsigned long elapsed = millis() - _baseMillis;
+            uint16_t driftError = _calibrated ? CLOCK_MAX_DRIFT_ERROR : CLOCK_UNCALIBRATED_DRIFT_ERROR;
+            return _baseAccuracy + (uint32_t)((uint64_t)elapsed * driftError / 1000000);
+        }
+
+        // Measured crystal drift, in ppm. Positive if millis() is slow.
+        float getDrift() {
+            return _drift;
+        }
+
+        bool isCalibrated() {
+            return _calibrated;
+        }
+
+        void getStatus(char* buffer, size_t size) {
+            if (!_set) {
+                strlcpy(buffer, "not synced", size);
+                return;
+            }
+
+            if (!_calibrated) {
+                snprintf(buffer, size, "error %lums, drift unknown", (unsigned long)getError());
+                return;
+            }
+            snprintf(buffer, size, "error %lums, drift %dppm", (unsigned long)getError(), (int)_drift);
+        }
+
+    private:
+        void setBase(uint64_t time, uint32_t accuracy, unsigned long now) {
+            _baseTime = time;
+            _baseMillis = now;
+            _baseAccuracy = accuracy;
+        }
+
+        static uint32_t readUint32(const uint8_t* data) {
+            return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+        }
+
+        bool _set = false;
+
+        // The time at the last sync used as the time base.
+        uint64_t _baseTime = 0;
+        unsigned long _baseMillis = 0;
+        uint32_t _baseAccuracy = 0;
+
+        // The reference for the next drift measurement.
+        uint64_t _calibrationTime = 0;
+        unsigned long _calibrationMillis = 0;
+        uint32_t _calibrationAccuracy = 0;
+
+        bool _calibrated = false;
+        float _drift = 0;
+};
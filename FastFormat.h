@@ -0,0 +1,107 @@
+#pragma once
+
+#include "Arduino.h"
+
+const uint32_t FAST_FORMAT_POWERS_OF_10[] PROGMEM = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+/*
+ * Number to text conversion without printf.
+ *
+ * The soft-float printf is slow on the ESP8266. The float conversion here is done with integer
+ * arithmetic on the exact binary value of the float and rounds the same way (to nearest, ties to
+ * even), so the output is identical to printf("%.*f"). Values that can't be converted exactly
+ * this way (NaN, infinity, above 2^33 or with more than 9 digits precision) fall back to printf.
+ *
+ * All methods write the text without the terminating '\0' and return its length. Nothing is
+ * written if the text is longer than the size, so the caller can detect that by the result.
+ */
+class FastFormat {
+    public:
+        static size_t formatString(char* buffer, size_t size, const char* value) {
+            size_t length = strlen(value);
+            if (length <= size) {
+                memcpy(buffer, value, length);
+            }
+            return length;
+        }
+
+        static size_t formatUnsigned(char* buffer, size_t size, uint64_t value) {
+            char digits[20];
+            size_t length = 0;
+            do {
+                digits[length++] = '0' + value % 10;
+                value /= 10;
+            } while (value > 0);
+
+            if (length <= size) {
+                for (size_t i = 0; i < length; i++) {
+                    buffer[i] = digits[length - 1 - i];
+                }
+            }
+            return length;
+        }
+
+        static size_t formatFloat(char* buffer, size_t size, float value, uint8_t precision) {
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            bool negative = bits >> 31;
+            int16_t exponent = (bits >> 23) & 0xFF;
+            uint64_t mantissa = bits & 0x7FFFFF;
+
+            if (exponent == 0xFF || exponent - 150 >= 10 || precision > 9) {
+                char text[64];
+                snprintf(text, sizeof(text), "%.*f", precision, value);
+                return formatString(buffer, size, text);
+            }
+
+            // value = mantissa * 2^exponent
+            if (exponent == 0) {
+                exponent = -149;
+            } else {
+                mantissa |= 0x800000;
+                exponent -= 150;
+            }
+
+            // Scale by 10^precision and round to integer. The mantissa is below 2^24 and the power
+            // of 10 below 2^30, so the product fits in 64 bits.
+            uint32_t power = pgm_read_dword(FAST_FORMAT_POWERS_OF_10 + precision);
+            uint64_t scaled = mantissa * power;
+            if (exponent >= 0) {
+                scaled <<= exponent;
+            } else if (exponent > -64) {
+                uint8_t shift = -exponent;
+                uint64_t remainder = scaled & ((1ULL << shift) - 1);
+                uint64_t half = 1ULL << (shift - 1);
+                scaled >>= shift;
+                if (remainder > half || (remainder == half && (scaled & 1))) {
+                    scaled++;
+                }
+            } else {
+                // Below 2^-40, rounds to 0.
+                scaled = 0;
+            }
+
+            char text[32];
+            size_t length = 0;
+            if (negative) {
+                text[length++] = '-';
+            }
+            length += formatUnsigned(text + length, sizeof(text) - length, scaled / power);
+            if (precision > 0) {
+                text[length++] = '.';
+                uint32_t fraction = scaled % power;
+                for (uint8_t i = precision; i > 0; i--) {
+                    text[length + i - 1] = '0' + fraction % 10;
+                    fraction /= 10;
+                }
+                length += precision;
+            }
+
+            if (length <= size) {
+                memcpy(buffer, text, length);
+            }
+            return length;
+        }
+};
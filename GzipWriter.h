@@ -0,0 +1,348 @@
+#pragma once
+
+#include "Arduino.h"
+#include <new>
+
+// Size of the LZ77 window is 2^GZIP_WINDOW_BITS. RAM usage is about 5 times the window size.
+#ifndef GZIP_WINDOW_BITS
+#define GZIP_WINDOW_BITS 10
+#endif
+
+// Number of previous occurrences checked when looking for a match. More is slower, but compresses
+// better.
+#ifndef GZIP_MAX_CHAIN
+#define GZIP_MAX_CHAIN 8
+#endif
+
+// Size of the buffer for the compressed data. It is flushed to the output when full.
+#ifndef GZIP_OUTPUT_SIZE
+#define GZIP_OUTPUT_SIZE 512
+#endif
+
+#define GZIP_WINDOW_SIZE (1 << GZIP_WINDOW_BITS)
+#define GZIP_HASH_BITS 9
+#define GZIP_HASH_SIZE (1 << GZIP_HASH_BITS)
+#define GZIP_MIN_MATCH 3
+#define GZIP_MAX_MATCH 258
+// The data that should be available after a position for finding the longest match.
+#define GZIP_MIN_LOOKAHEAD (GZIP_MAX_MATCH + GZIP_MIN_MATCH)
+
+static_assert(GZIP_WINDOW_BITS >= 9 && GZIP_WINDOW_BITS <= 14, "GZIP_WINDOW_BITS should be from 9 to 14");
+
+// Base values and extra bits for the length codes 257..285 (RFC 1951, section 3.2.5).
+const uint16_t GZIP_LENGTH_BASE[] PROGMEM = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+const uint8_t GZIP_LENGTH_EXTRA[] PROGMEM = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+// Base values and extra bits for the distance codes 0..29.
+const uint16_t GZIP_DISTANCE_BASE[] PROGMEM = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+const uint8_t GZIP_DISTANCE_EXTRA[] PROGMEM = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// CRC-32 lookup table, processing 4 bits at a time.
+const uint32_t GZIP_CRC_TABLE[] PROGMEM = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+/*
+ * Streaming gzip compressor.
+ *
+ * Deflate with LZ77 over a small window and the fixed Huffman codes. The whole stream is a single
+ * block, so the data can be written in pieces of any size without knowing the total length. The
+ * compressed data is written to the output as it gets available.
+ *
+ * Line protocol is very repetitive, so even the small window gives good compression ratio.
+ */
+class GzipWriter : public Print {
+    public:
+        GzipWriter(Print* output) {
+            _output = output;
+        }
+
+        ~GzipWriter() {
+            end();
+        }
+
+        // Allocate the buffers and write the gzip header. Returns false if there is not enough
+        // memory.
+        bool begin() {
+            _window = new (std::nothrow) uint8_t[2 * GZIP_WINDOW_SIZE];
+            _head = new (std::nothrow) uint16_t[GZIP_HASH_SIZE];
+            _prev = new (std::nothrow) uint16_t[GZIP_WINDOW_SIZE];
+            if (_window == NULL || _head == NULL || _prev == NULL) {
+                end();
+                _failed = true;
+                return false;
+            }
+            memset(_head, 0, GZIP_HASH_SIZE * sizeof(uint16_t));
+
+            // Magic, deflate method, no flags, no modification time, no extra flags, unknown OS.
+            const uint8_t header[] = {0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF};
+            for (uint8_t i = 0; i < sizeof(header); i++) {
+                putByte(header[i]);
+            }
+
+            // The only block - final, with fixed Huffman codes.
+            putBits(1, 1);
+            putBits(1, 2);
+            return true;
+        }
+
+        size_t write(uint8_t data) override {
+            return write(&data, 1);
+        }
+
+        size_t write(const uint8_t *buffer, size_t size) override {
+            if (_window == NULL) {
+                return 0;
+            }
+
+            size_t written = 0;
+            while (written < size) {
+                if (_end == 2 * GZIP_WINDOW_SIZE) {
+                    compress(_end - GZIP_MIN_LOOKAHEAD);
+                    slide();
+                }
+
+                size_t count = min(size - written, (size_t)(2 * GZIP_WINDOW_SIZE - _end));
+                memcpy(_window + _end, buffer + written, count);
+                _crc = crc32(_crc, buffer + written, count);
+                _end += count;
+                written += count;
+            }
+
+            _bytesIn += size;
+            return size;
+        }
+
+        // Compress the remaining data and write the gzip trailer.
+        bool finish() {
+            if (_window == NULL) {
+                return false;
+            }
+
+            compress(_end);
+            putSymbol(256);     // End of block.
+            if (_bitCount > 0) {
+                putByte(_bitBuffer);
+                _bitBuffer = 0;
+                _bitCount = 0;
+            }
+
+            uint32_t crc = ~_crc;
+            for (uint8_t i = 0; i < 4; i++) {
+                putByte(crc >> (8 * i));
+            }
+            for (uint8_t i = 0; i < 4; i++) {
+                putByte(_bytesIn >> (8 * i));
+            }
+
+            flushOutput();
+            end();
+            return !_failed;
+        }
+
+        // Release the buffers.
+        void end() {
+            delete[] _window;
+            delete[] _head;
+            delete[] _prev;
+            _window = NULL;
+            _head = NULL;
+            _prev = NULL;
+        }
+
+        size_t bytesIn() {
+            return _bytesIn;
+        }
+
+        size_t bytesOut() {
+            return _bytesOut;
+        }
+
+    private:
+        // Encode the data up to the specified position in the window.
+        void compress(uint16_t limit) {
+            while (_pos < limit) {
+                uint16_t distance = 0;
+                uint16_t length = findMatch(distance);
+
+                if (length >= GZIP_MIN_MATCH) {
+                    putMatch(length, distance);
+                    for (uint16_t i = 0; i < length; i++) {
+                        insertHash(_pos++);
+                    }
+                } else {
+                    putSymbol(_window[_pos]);
+                    insertHash(_pos++);
+                }
+            }
+        }
+
+        // Find the longest match for the data at the current position. Returns its length.
+        uint16_t findMatch(uint16_t& distance) {
+            if (_pos + GZIP_MIN_MATCH > _end) {
+                return 0;
+            }
+
+            uint16_t maxLength = min((uint16_t)GZIP_MAX_MATCH, (uint16_t)(_end - _pos));
+            uint16_t bestLength = 0;
+            // Positions in the hash table are stored with +1, 0 marks an empty entry.
+            uint16_t candidate = _head[hash(_pos)];
+            uint16_t previous = _pos + 1;
+
+            for (uint8_t chain = 0; chain < GZIP_MAX_CHAIN && candidate > 0 && candidate < previous; chain++) {
+                uint16_t start = candidate - 1;
+                if (_pos - start >= GZIP_WINDOW_SIZE) {
+                    break;
+                }
+
+                uint16_t length = 0;
+                while (length < maxLength && _window[start + length] == _window[_pos + length]) {
+                    length++;
+                }
+
+                if (length > bestLength) {
+                    bestLength = length;
+                    distance = _pos - start;
+                    if (length == maxLength) {
+                        break;
+                    }
+                }
+
+                previous = candidate;
+                candidate = _prev[start & (GZIP_WINDOW_SIZE - 1)];
+            }
+
+            return bestLength;
+        }
+
+        void insertHash(uint16_t pos) {
+            if (pos + GZIP_MIN_MATCH > _end) {
+                return;
+            }
+            uint16_t h = hash(pos);
+            _prev[pos & (GZIP_WINDOW_SIZE - 1)] = _head[h];
+            _head[h] = pos + 1;
+        }
+
+        uint16_t hash(uint16_t pos) {
+            uint32_t value = (_window[pos] << 16) | (_window[pos + 1] << 8) | _window[pos + 2];
+            return (value * 2654435761u) >> (32 - GZIP_HASH_BITS);
+        }
+
+        // Move the upper half of the window to the lower one and update the positions.
+        void slide() {
+            memmove(_window, _window + GZIP_WINDOW_SIZE, GZIP_WINDOW_SIZE);
+            _end -= GZIP_WINDOW_SIZE;
+            _pos -= GZIP_WINDOW_SIZE;
+            for (uint16_t i = 0; i < GZIP_HASH_SIZE; i++) {
+                _head[i] = _head[i] > GZIP_WINDOW_SIZE ? _head[i] - GZIP_WINDOW_SIZE : 0;
+            }
+            for (uint16_t i = 0; i < GZIP_WINDOW_SIZE; i++) {
+                _prev[i] = _prev[i] > GZIP_WINDOW_SIZE ? _prev[i] - GZIP_WINDOW_SIZE : 0;
+            }
+        }
+
+        void putMatch(uint16_t length, uint16_t distance) {
+            uint8_t code = 28;
+            while (pgm_read_word(GZIP_LENGTH_BASE + code) > length) {
+                code--;
+            }
+            putSymbol(257 + code);
+            putBits(length - pgm_read_word(GZIP_LENGTH_BASE + code), pgm_read_byte(GZIP_LENGTH_EXTRA + code));
+
+            code = 29;
+            while (pgm_read_word(GZIP_DISTANCE_BASE + code) > distance) {
+                code--;
+            }
+            putBits(reverse(code, 5), 5);
+            putBits(distance - pgm_read_word(GZIP_DISTANCE_BASE + code), pgm_read_byte(GZIP_DISTANCE_EXTRA + code));
+        }
+
+        // Write literal/length symbol with the fixed Huffman code.
+        void putSymbol(uint16_t symbol) {
+            if (symbol < 144) {
+                putBits(reverse(0x30 + symbol, 8), 8);
+            } else if (symbol < 256) {
+                putBits(reverse(0x190 + symbol - 144, 9), 9);
+            } else if (symbol < 280) {
+                putBits(reverse(symbol - 256, 7), 7);
+            } else {
+                putBits(reverse(0xC0 + symbol - 280, 8), 8);
+            }
+        }
+
+        // Huffman codes are packed starting with the most significant bit.
+        uint16_t reverse(uint16_t code, uint8_t bits) {
+            uint16_t result = 0;
+            for (uint8_t i = 0; i < bits; i++) {
+                result = (result << 1) | (code & 1);
+                code >>= 1;
+            }
+            return result;
+        }
+
+        void putBits(uint32_t value, uint8_t bits) {
+            _bitBuffer |= value << _bitCount;
+            _bitCount += bits;
+            while (_bitCount >= 8) {
+                putByte(_bitBuffer);
+                _bitBuffer >>= 8;
+                _bitCount -= 8;
+            }
+        }
+
+        void putByte(uint8_t data) {
+            _out[_outSize++] = data;
+            if (_outSize == sizeof(_out)) {
+                flushOutput();
+            }
+        }
+
+        void flushOutput() {
+            if (_outSize > 0 && _output->write(_out, _outSize) != _outSize) {
+                _failed = true;
+            }
+            _bytesOut += _outSize;
+            _outSize = 0;
+        }
+
+        uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+            while (size--) {
+                crc ^= *data++;
+                crc = (crc >> 4) ^ pgm_read_dword(GZIP_CRC_TABLE + (crc & 0x0F));
+                crc = (crc >> 4) ^ pgm_read_dword(GZIP_CRC_TABLE + (crc & 0x0F));
+            }
+            return crc;
+        }
+
+        Print* _output;
+        bool _failed = false;
+
+        uint8_t* _window = NULL;
+        uint16_t* _head = NULL;
+        uint16_t* _prev = NULL;
+        uint16_t _pos = 0;      // Next position to be encoded.
+        uint16_t _end = 0;      // End of the data in the window.
+
+        uint32_t _bitBuffer = 0;
+        uint8_t _bitCount = 0;
+        uint8_t _out[GZIP_OUTPUT_SIZE];
+        uint16_t _outSize = 0;
+
+        uint32_t _crc = 0xFFFFFFFF;
+        size_t _bytesIn = 0;
+        size_t _bytesOut = 0;
+};
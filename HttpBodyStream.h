@@ -0,0 +1,116 @@
+#pragma once
+
+#include "Arduino.h"
+
+/*
+ * Body of an HTTP response, read straight from the connection.
+ *
+ * Stops at the end of the body, so the parser can't read past it, and decodes the chunked
+ * transfer encoding. Once done with the response call skip(), the rest of the body has to be
+ * read before the connection can be reused for the next request.
+ */
+class HttpBodyStream : public Stream {
+    public:
+        // The size is the Content-Length, or -1 if unknown. Without the length and the chunked
+        // encoding the body ends with the connection.
+        HttpBodyStream(Stream* stream, int size, bool chunked, unsigned long timeout) {
+            _stream = stream;
+            _chunked = chunked;
+            _remaining = chunked ? 0 : (size >= 0 ? size : -1);
+            setTimeout(timeout);
+        }
+
+        int available() override {
+            if (!prepare()) {
+                return 0;
+            }
+            int available = _stream->available();
+            return _remaining >= 0 && _remaining < available ? _remaining : available;
+        }
+
+        int read() override {
+            if (!prepare()) {
+                return -1;
+            }
+            int c = _stream->read();
+            if (c >= 0) {
+                _bytesRead++;
+                if (_remaining > 0) {
+                    _remaining--;
+                }
+            }
+            return c;
+        }
+
+        int peek() override {
+            if (!prepare()) {
+                return -1;
+            }
+            return _stream->peek();
+        }
+
+        size_t write(uint8_t) override {
+            return 0;
+        }
+
+        // Read and drop the rest of the body. Returns false if the end of the body wasn't
+        // reached - the connection can't be reused then.
+        bool skip() {
+            while (prepare()) {
+                if (timedRead() < 0) {
+                    return false;
+                }
+            }
+            return _remaining == 0 && !_broken;
+        }
+
+        uint32_t getBytesRead() {
+            return _bytesRead;
+        }
+
+    private:
+        // Make sure there is data left in the body. Reads the next chunk header, if needed.
+        bool prepare() {
+            if (_remaining != 0) {
+                return true;
+            }
+            if (!_chunked || _finished) {
+                return false;
+            }
+
+            char line[16];
+            if (_inChunk) {
+                // The CRLF after the chunk data.
+                _stream->readBytesUntil('\n', line, sizeof(line));
+            }
+            size_t length = _stream->readBytesUntil('\n', line, sizeof(line) - 1);
+            line[length] = '\0';
+            char* end;
+            long size = strtol(line, &end, 16);
+            if (end == line || size < 0) {
+                // Broken chunk header, the end of the body is unknown.
+                _finished = true;
+                _broken = true;
+                return false;
+            }
+
+            _inChunk = true;
+            _remaining = size;
+            if (size == 0) {
+                // The last chunk. Skip the empty line after it, trailers are not expected.
+                _stream->readBytesUntil('\n', line, sizeof(line));
+                _finished = true;
+                return false;
+            }
+            return true;
+        }
+
+        Stream* _stream;
+        bool _chunked;
+        bool _inChunk = false;
+        bool _finished = false;
+        bool _broken = false;
+        // Bytes left in the body or in the current chunk. -1 if unknown.
+        long _remaining;
+        uint32_t _bytesRead = 0;
+};
@@ -0,0 +1,288 @@
+#pragma once
+
+#include <ESP8266WiFi.h>
+#include <WiFiClient.h>
+
+#include "Logger.h"
+
+// Timeout for connecting and for the responses, in milliseconds.
+#ifndef HTTP_CONNECTION_TIMEOUT
+#define HTTP_CONNECTION_TIMEOUT 5000
+#endif
+
+// Status code of a request that can't start, as another request has the connection.
+#define HTTP_CONNECTION_BUSY -20
+
+/*
+ * Keep-alive HTTP connection to a single server.
+ *
+ * The server address, like 'http://192.168.0.1:8086', is parsed once and its host name is resolved
+ * once, on the first request after an address change or a failure. The TCP connection is kept
+ * open between the requests, so a burst of requests while the WiFi is up does a single handshake.
+ * Share the same instance between all components that talk to the same server. The connection
+ * carries one request at a time - its owner takes it with lock() before the request and gives it
+ * back with unlock() once the response is read.
+ */
+class HttpConnection {
+    public:
+        HttpConnection(Logger* logger) {
+            _logger = logger;
+        }
+
+        void begin() {
+            _client.setTimeout(HTTP_CONNECTION_TIMEOUT);
+        }
+
+        // Take the connection for a request. Returns false if another owner has it, the caller
+        // should try again once that request is done.
+        bool lock(const void* owner) {
+            if (isBusy(owner)) {
+                return false;
+            }
+            _owner = owner;
+            return true;
+        }
+
+        void unlock(const void* owner) {
+            if (_owner == owner) {
+                _owner = NULL;
+            }
+        }
+
+        // True if another owner has the connection.
+        bool isBusy(const void* owner) {
+            return _owner != NULL && _owner != owner;
+        }
+
+        // Get the connection for a request. It is reused if still open. Returns NULL if the
+        // connection fails.
+        //
+        // A connection the server closed while idle can still look open, that shows only once
+        // the request is sent. If it fails before any of the response is received, report it
+        // with stale() and send the request again on a new connection.
+        WiFiClient* connect(const char* address) {
+            if (!resolve(address)) {
+                return NULL;
+            }
+
+            _reused = _client.connected();
+            if (_reused) {
+                _reuses++;
+                return &_client;
+            }
+            _connects++;
+            if (!_client.connect(_ip, _port)) {
+                _logger->warn(LOG_MODULE_INFLUXDB, "Can't connect to %s:%d", _host, _port);
+                failed();
+                return NULL;
+            }
+            return &_client;
+        }
+
+        // True if the last connect() reused the open connection.
+        bool isReused() {
+            return _reused;
+        }
+
+        // The reused connection was closed by the server. Close it, the next connect() opens a
+        // new one.
+        void stale() {
+            _client.stop();
+            _stale++;
+        }
+
+        // Write the request line and the Host header of a request to the uri, relative to the
+        // address path. Written in parts, so a long uri isn't formatted in a buffer.
+        void writeRequest(const char* method, const char* uri) {
+            char host[96];
+            snprintf(host, sizeof(host), " HTTP/1.1\r\nHost: %s:%d\r\n", _host, _port);
+            _client.print(method);
+            _client.print(" ");
+            _client.print(_path);
+            _client.print(uri);
+            _client.print(host);
+        }
+
+        // Close the connection after a failure. The host name will be resolved again, in case its
+        // IP has changed.
+        void failed() {
+            _client.stop();
+            _resolved = false;
+        }
+
+        // Close the connection, like before turning the WiFi off.
+        void stop() {
+            _client.stop();
+        }
+
+        // Parse the address and resolve the host, unless already done for the same address.
+        bool resolve(const char* address) {
+            if (strcmp(address, _address) != 0) {
+                _client.stop();
+                _resolved = false;
+                if (!parseAddress(address)) {
+                    _address[0] = '\0';
+                    _logger->warn(LOG_MODULE_INFLUXDB, "Invalid address: %s", address);
+                    return false;
+                }
+                strlcpy(_address, address, sizeof(_address));
+            }
+
+            if (!_resolved) {
+                _lookups++;
+                if (!WiFi.hostByName(_host, _ip)) {
+                    _logger->warn(LOG_MODULE_INFLUXDB, "Can't resolve %s", _host);
+                    return false;
+                }
+                _resolved = true;
+            }
+            return true;
+        }
+
+        const char* getHost() {
+            return _host;
+        }
+
+        IPAddress getIP() {
+            return _ip;
+        }
+
+        uint16_t getPort() {
+            return _port;
+        }
+
+        // The path prefix from the address, without the trailing '/'.
+        const char* getPath() {
+            return _path;
+        }
+
+        uint32_t getConnects() {
+            return _connects;
+        }
+
+        uint32_t getReuses() {
+            return _reuses;
+        }
+
+        void getStatus(char* buffer, size_t size) {
+            snprintf(
+                buffer,
+                size,
+                "%lu connects, %lu reused, %lu stale, %lu DNS lookups",
+                (unsigned long)_connects,
+                (unsigned long)_reuses,
+                (unsigned long)_stale,
+                (unsigned long)_lookups);
+        }
+
+        // Parse the Date header value, like "Sat, 08 Dec 2018 07:38:17 GMT", to seconds since epoch.
+        // Returns 0 if the value is invalid.
+        static uint32_t parseDate(const char* dateTime) {
+            if (strlen(dateTime) != 29) {
+                // Something's wrong. The datetime should be 29 characters.
+                return 0;
+            }
+            // Calculate the timestamp from a date/time string as "Sat, 08 Dec 2018 07:38:17 GMT". Based on
+            // the "Seconds Since the Epoch" formula as defined by POSIX:2008 section 4.15. The following
+            // are the required parameters:
+            int16_t tm_sec = atoi(dateTime+23);         // seconds
+            int16_t tm_min = atoi(dateTime+20);         // minutes
+            int16_t tm_hour = atoi(dateTime+17);        // hours
+            int16_t tm_year = atoi(dateTime+12) - 1900; // calendar year minus 1900
+            int16_t tm_yday;                            // passed days since January 1 of the current year
+
+            // tm_yday is calculated based on the month, the day and on the year (leap/non-leap).
+
+            // Day in current month
+            int16_t day = atoi(dateTime+5);
+
+            // Convert month to number. 1 for January, 12 for December.
+            const char* months[12] = {
+                "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+            };
+            int16_t month = 1;
+            while (strncmp(dateTime + 8, months[month-1], 3) != 0 && month < 13) {
+                month++;
+            }
+
+            // Determine if the year is leap or not.
+            bool isLeapYear = false;
+            if ((tm_year + 1900) % 4 == 0 )
+                isLeapYear = true;
+            if ((tm_year + 1900) % 100 == 0 )
+                isLeapYear = false;
+            if ((tm_year + 1900) % 400 == 100 )
+                isLeapYear = true;
+
+            // Calculate the number of passed days before the current month.
+            int16_t days_before_month[2][13] = {
+                /* Normal years.  */
+                {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365},
+                /* Leap years.  */
+                {0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335, 366}
+            };
+
+            // Calculate the full days that have passed since the year start.
+            tm_yday = days_before_month[isLeapYear][month-1] + day-1;
+
+            return
+                tm_sec + tm_min*60 +
+                tm_hour*3600 +
+                tm_yday*86400 +
+                (tm_year-70)*31536000 +
+                ((tm_year-69)/4)*86400 -
+                ((tm_year-1)/100)*86400 +
+                ((tm_year+299)/400)*86400;
+        }
+
+    private:
+        // Split the address, like 'http://192.168.0.1:8086', to host, port and path prefix.
+        bool parseAddress(const char* address) {
+            const char* start = address;
+            if (strncmp(start, "http://", 7) == 0) {
+                start += 7;
+            }
+
+            size_t hostLength = strcspn(start, ":/");
+            if (hostLength == 0 || hostLength >= sizeof(_host)) {
+                return false;
+            }
+            memcpy(_host, start, hostLength);
+            _host[hostLength] = '\0';
+
+            _port = 80;
+            const char* path = start + hostLength;
+            if (*path == ':') {
+                _port = atoi(path + 1);
+                path += strcspn(path, "/");
+            }
+
+            // Skip the trailing '/', it is part of the request path.
+            if (strcmp(path, "/") == 0) {
+                path++;
+            }
+            if (strlen(path) >= sizeof(_path)) {
+                return false;
+            }
+            strcpy(_path, path);
+            return _port > 0;
+        }
+
+        Logger* _logger;
+        WiFiClient _client;
+        const void* _owner = NULL;
+
+        // The parsed address and the resolved host IP.
+        char _address[64] = "";
+        char _host[64];
+        uint16_t _port;
+        char _path[32];
+        IPAddress _ip;
+        bool _resolved = false;
+        bool _reused = false;
+
+        uint32_t _connects = 0;
+        uint32_t _reuses = 0;
+        uint32_t _stale = 0;
+        uint32_t _lookups = 0;
+};
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <ESP8266HTTPClient.h>
+#include <WiFiClient.h>
+
+#include "Logger.h"
+#include "TelemetryTransport.h"
+#include "HttpConnection.h"
+#include "AsyncHttpRequest.h"
+#include "ChunkedWriter.h"
+#include "GzipWriter.h"
+#include "UrlBuilder.h"
+
+// Timeout for the InfluxDB response on a chunked push.
+#ifndef TELEMETRY_RESPONSE_TIMEOUT
+#define TELEMETRY_RESPONSE_TIMEOUT 5000
+#endif
+
+// Size of the write uri. The database name can be encoded to 3 times its length, 72 bytes fit a
+// 15 characters name.
+#ifndef HTTP_TRANSPORT_URI_SIZE
+#define HTTP_TRANSPORT_URI_SIZE 72
+#endif
+
+/*
+ * Line protocol over HTTP, to the /write endpoint of InfluxDB.
+ *
+ * Batched - the data is rendered and pushed in batches of up to the buffer size, each in a
+ * separate request. The requests can also be moved forward by the caller's loop, with
+ * nextBatch(), startBatch() and finishBatch(), so they don't block.
+ *
+ * Chunked - the data is streamed in a single request with chunked transfer encoding, optionally
+ * gzip compressed. The memory usage doesn't depend on the data size, but it blocks until the
+ * response is read.
+ *
+ * The requests go over the AsyncHttpRequest of the caller, which also owns the shared connection
+ * during the chunked request.
+ */
+class HttpTransport : public TelemetryTransport {
+    public:
+        // The buffer is used for rendering the batches.
+        HttpTransport(Logger* logger, char* buffer, size_t size) : _writeUri(_writeUriBuffer, sizeof(_writeUriBuffer)) {
+            _logger = logger;
+            _buffer = buffer;
+            _size = size;
+        }
+
+        void begin(HttpConnection* connection, AsyncHttpRequest* request) {
+            _connection = connection;
+            _request = request;
+        }
+
+        // The address, like 'http://192.168.0.1:8086', must stay valid. The write uri depends only
+        // on the database, so it is built once here.
+        void setTarget(const char* address, const char* database) {
+            _address = address;
+            _writeUri.clear();
+            _writeUri.append("/write?precision=s&db=").appendEncoded(database);
+        }
+
+        void setChunked(bool chunked, bool compressed) {
+            _chunked = chunked;
+            _compressed = compressed;
+        }
+
+        bool send(TelemetrySource* source, size_t limit) override {
+            _date[0] = '\0';
+            if (_chunked) {
+                return pushChunked(source, _compressed, limit);
+            }
+            return pushBatched(source, limit);
+        }
+
+        const char* getDate() override {
+            return _date;
+        }
+
+        // Start a batched push from the source.
+        void rewind(TelemetrySource* source) {
+            _pushed = 0;
+            _date[0] = '\0';
+            source->rewind();
+        }
+
+        // Render the next batch in the buffer. Returns false if there is nothing more to push.
+        bool nextBatch(TelemetrySource* source, size_t limit) {
+            if (!source->available() || _pushed >= limit) {
+                return false;
+            }
+            _batchSize = source->read(_buffer, _size);
+            return _batchSize > 0;
+        }
+
+        // Start the request for the rendered batch. Returns false if the connection fails.
+        bool startBatch(TelemetrySource* source) {
+            _batchStartedAt = millis();
+            // -1 to remove the last '\n'.
+            if (!_request->start(_address, "POST", _writeUri.c_str(), _buffer, _batchSize - 1)) {
+                source->rewind();
+                _logger->warn(LOG_MODULE_INFLUXDB, "Push failed, can't connect to %s", _address);
+                return false;
+            }
+            return true;
+        }
+
+        // Commit the batch if it was pushed and end its request.
+        bool finishBatch(TelemetrySource* source) {
+            int statusCode = _request->getStatusCode();
+            bool success = statusCode == 204;
+            if (success) {
+                stats.record(_batchSize, _batchStartedAt);
+                source->commit();
+                _pushed += _batchSize;
+                strlcpy(_date, _request->getDate(), sizeof(_date));
+            } else {
+                source->rewind();
+                _logger->warn(LOG_MODULE_INFLUXDB, "Push failed with HTTP %d", statusCode);
+            }
+            _request->end(success);
+            return success;
+        }
+
+    private:
+        bool pushBatched(TelemetrySource* source, size_t limit) {
+            // Each pushed batch is dropped from the source, so a failure doesn't resend it.
+            rewind(source);
+            while (nextBatch(source, limit)) {
+                if (!startBatch(source)) {
+                    return false;
+                }
+                _request->complete();
+                if (!finishBatch(source)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Stream the whole source in a single request. The line protocol is rendered batch by
+        // batch and each batch is send as a chunk. If compressed - the batches go through a
+        // streaming gzip compressor.
+        bool pushChunked(TelemetrySource* source, bool compressed, size_t limit) {
+            if (!_connection->lock(_request)) {
+                return false;
+            }
+            bool stale = false;
+            bool success = sendChunked(source, compressed, limit, stale);
+            if (stale) {
+                // The reused connection was closed by the server, see HttpConnection::connect().
+                _connection->stale();
+                success = sendChunked(source, compressed, limit, stale);
+            }
+            _connection->unlock(_request);
+            return success;
+        }
+
+        // Send the chunked request. The stale flag is set if it failed on a reused connection
+        // before any of the response was received.
+        bool sendChunked(TelemetrySource* source, bool compressed, size_t limit, bool& stale) {
+            WiFiClient* client = _connection->connect(_address);
+            if (client == NULL) {
+                _logger->warn(LOG_MODULE_INFLUXDB, "Push failed, can't connect to %s", _address);
+                return false;
+            }
+
+            ChunkedWriter writer(client);
+            GzipWriter gzip(&writer);
+            if (compressed && !gzip.begin()) {
+                _logger->warn(LOG_MODULE_INFLUXDB, "Not enough memory for gzip, pushing uncompressed");
+                compressed = false;
+            }
+            Print* body = compressed ? (Print*)&gzip : (Print*)&writer;
+
+            unsigned long startedAt = millis();
+            _connection->writeRequest("POST", _writeUri.c_str());
+            client->print("Content-Type: text/plain\r\n");
+            if (compressed) {
+                client->print("Content-Encoding: gzip\r\n");
+            }
+            client->print("Transfer-Encoding: chunked\r\n\r\n");
+
+            size_t pushed = 0;
+            source->rewind();
+            while (source->available() && !writer.failed() && pushed < limit) {
+                size_t size = source->read(_buffer, _size);
+                if (size == 0) {
+                    break;
+                }
+                body->write((uint8_t*)_buffer, size);
+                pushed += size;
+            }
+
+            int statusCode = HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+            char date[32] = "";
+            if ((!compressed || gzip.finish()) && writer.finish()) {
+                statusCode = readResponse(client, date, sizeof(date));
+            }
+
+            // The 204 response has no body, so the connection can be reused. On any other response
+            // the rest of it is not read, so the connection is closed.
+            bool success = statusCode == 204;
+            stale = !success && _connection->isReused() && !client->connected() &&
+                (statusCode == HTTPC_ERROR_SEND_PAYLOAD_FAILED || statusCode == HTTPC_ERROR_READ_TIMEOUT);
+            if (success) {
+                stats.record(writer.bytesWritten(), startedAt);
+                source->commit();
+                strlcpy(_date, date, sizeof(_date));
+                if (compressed && gzip.bytesOut() > 0) {
+                    _logger->info(LOG_MODULE_INFLUXDB, "Pushed %u bytes gzipped to %u (%.1fx)",
+                                  (unsigned int)gzip.bytesIn(),
+                                  (unsigned int)gzip.bytesOut(),
+                                  (float)gzip.bytesIn() / gzip.bytesOut());
+                }
+            } else if (stale) {
+                source->rewind();
+            } else {
+                _connection->failed();
+                source->rewind();
+                _logger->warn(LOG_MODULE_INFLUXDB, "Chunked push of %u bytes failed with HTTP %d", (unsigned int)writer.bytesWritten(), statusCode);
+            }
+            return success;
+        }
+
+        // Read the response status line and headers. The value of the Date header is copied in the
+        // date buffer. Returns the HTTP status code or negative value on error.
+        int readResponse(WiFiClient* client, char* date, size_t dateSize) {
+            char line[64];
+            int statusCode = HTTPC_ERROR_READ_TIMEOUT;
+
+            client->setTimeout(TELEMETRY_RESPONSE_TIMEOUT);
+            while (true) {
+                size_t size = client->readBytesUntil('\n', line, sizeof(line) - 1);
+                if (size == 0) {
+                    // Timeout or malformed response.
+                    break;
+                }
+                line[size] = '\0';
+                if (line[size - 1] == '\r') {
+                    line[--size] = '\0';
+                }
+
+                if (size == 0) {
+                    // End of the headers.
+                    break;
+                }
+
+                if (strncmp(line, "HTTP/1.", 7) == 0 && size > 9) {
+                    statusCode = atoi(line + 9);
+                } else if (strncasecmp(line, "date: ", 6) == 0) {
+                    strlcpy(date, line + 6, dateSize);
+                }
+            }
+
+            return statusCode;
+        }
+
+        Logger* _logger;
+        HttpConnection* _connection = NULL;
+        AsyncHttpRequest* _request = NULL;
+        const char* _address = "";
+        char _writeUriBuffer[HTTP_TRANSPORT_URI_SIZE];
+        UrlBuilder _writeUri;
+        bool _chunked = false;
+        bool _compressed = false;
+
+        char* _buffer;
+        size_t _size;
+        size_t _pushed = 0;
+        size_t _batchSize = 0;
+        unsigned long _batchStartedAt = 0;
+        // The Date header of the last successful response.
+        char _date[32] = "";
+};
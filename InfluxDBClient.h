@@ -2,15 +2,66 @@
 
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 
-#include <ESP8266HTTPClient.h>
-
 #include "Logger.h"
 #include "WiFi.h"
 #include "WebServerBase.h"
+#include "RetryPolicy.h"
+#include "HttpConnection.h"
+#include "AsyncHttpRequest.h"
+#include "UrlBuilder.h"
 // Compatible with version 6 of the ArduinoJson library.
 #include <ArduinoJson.h>
 
-#define JSON_DOC_CAPACITY 3*JSON_ARRAY_SIZE(1) + 2*JSON_ARRAY_SIZE(2) + JSON_OBJECT_SIZE(1) + JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(3) + 120
+// Maximum number of the values fetched with subscribe().
+#ifndef INFLUXDB_MAX_SUBSCRIPTIONS
+#define INFLUXDB_MAX_SUBSCRIPTIONS 10
+#endif
+
+// A subscribed value is stale once it wasn't refreshed for that many query intervals.
+#ifndef INFLUXDB_STALE_QUERIES
+#define INFLUXDB_STALE_QUERIES 2
+#endif
+
+// Number of past minutes of the settings metric kept for query(minutesAgo), with the last value of
+// each minute. The older minutes are queried on each call.
+#ifndef INFLUXDB_HISTORY_SIZE
+#define INFLUXDB_HISTORY_SIZE 32
+#endif
+
+// The history is answered locally for that many seconds after a fetch.
+#ifndef INFLUXDB_HISTORY_REFRESH
+#define INFLUXDB_HISTORY_REFRESH 60
+#endif
+
+// The newest values are fetched again on refresh, as the data can be published with a delay, like
+// by a collector that pushes on intervals. In seconds.
+#ifndef INFLUXDB_HISTORY_OVERLAP
+#define INFLUXDB_HISTORY_OVERLAP 300
+#endif
+
+// Size of the query uri, enough for a statement for the settings metric and each subscription.
+#ifndef INFLUXDB_CLIENT_URI_SIZE
+#define INFLUXDB_CLIENT_URI_SIZE (64 + (INFLUXDB_MAX_SUBSCRIPTIONS + 1) * 160)
+#endif
+
+// One statement result of the filtered response - {"statement_id":0,"series":[{"values":[[<time>,<value>]]}]}.
+#define JSON_RESULT_SIZE (JSON_OBJECT_SIZE(2) + 2*JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(1) + JSON_ARRAY_SIZE(2))
+// The filtered response with a result for the settings metric and each subscription. The times are
+// integers (epoch=s) and the keys are stored once, so the rest is for the keys.
+#define JSON_DOC_CAPACITY (JSON_OBJECT_SIZE(1) + JSON_ARRAY_SIZE(INFLUXDB_MAX_SUBSCRIPTIONS + 1) + \
+                           (INFLUXDB_MAX_SUBSCRIPTIONS + 1)*JSON_RESULT_SIZE + 64)
+// The filtered response to a history query, with a row per minute. The window starts within a
+// minute, so there is one more row than minutes.
+#define JSON_HISTORY_CAPACITY (JSON_OBJECT_SIZE(1) + JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(2) + JSON_ARRAY_SIZE(1) + \
+                               JSON_OBJECT_SIZE(1) + JSON_ARRAY_SIZE(INFLUXDB_HISTORY_SIZE + 1) + \
+                               (INFLUXDB_HISTORY_SIZE + 1)*JSON_ARRAY_SIZE(2) + 64)
+// The filter - {"results":[{"statement_id":true,"series":[{"values":true}]}]}.
+#define JSON_FILTER_CAPACITY (JSON_OBJECT_SIZE(1) + JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(1) + 2*JSON_ARRAY_SIZE(1))
+
+// The subscription has a value.
+#define INFLUXDB_VALUE_AVAILABLE 0x01
+// The value was returned by the last successful query.
+#define INFLUXDB_VALUE_UPDATED 0x02
 
 const char INFLUXDB_CLIENT_CONFIG_PAGE[] PROGMEM = R"=====(
 <fieldset style='display: inline-block; width: 300px'>
@@ -33,9 +84,36 @@ Query interval:<br>
 Query window:<br>
 <input type="text" name="ifxc_lb" value="%d"><br>
 <small><em>Look back minutes, from 0 to 65535</em></small><br><br>
+Status:<br>
+<small><em>%s</em></small><br>
+History:<br>
+<small><em>%s</em></small><br>
+Subscriptions:<br>
+<small><em>%s</em></small><br>
+Response parsing:<br>
+<small><em>%s</em></small><br>
+Connection:<br>
+<small><em>%s</em></small><br>
+Requests:<br>
+<small><em>%s</em></small><br>
 </fieldset>
 )=====";
 
+// A value fetched on each query. The metric and src strings are not copied.
+struct InfluxDBSubscription {
+    const char* metric;
+    const char* src;
+    float value;
+    uint32_t time;              // Time of the data point, in seconds since epoch.
+    unsigned long updatedAt;    // millis() of the query that returned the value.
+    uint8_t flags;
+};
+
+struct InfluxDBHistoryEntry {
+    uint32_t time;              // Start of the minute, in seconds since epoch.
+    float value;                // The last value in the minute.
+};
+
 struct InfluxDBClientSettings {
     char address[64];
     char database[16];
@@ -50,17 +128,27 @@ class InfluxDBClient {
         InfluxDBClient(Logger* _logger,
                        WiFiManager* _wifi,
                        InfluxDBClientSettings* settings,
-                       NetworkSettings* networkSettings) {
+                       NetworkSettings* networkSettings,
+                       HttpConnection* connection=NULL) : _uri(_uriBuffer, sizeof(_uriBuffer)) {
             this->_logger = _logger;
             this->_wifi = _wifi;
             this->_settings = settings;
             this->_networkSettings = networkSettings;
+            this->_connection = connection;
         }
 
         void begin() {
-            http = new HTTPClient();
-            doc = new DynamicJsonDocument(JSON_DOC_CAPACITY);
+            if (_connection == NULL) {
+                _connection = new HttpConnection(_logger);
+            }
+            _connection->begin();
+            _request.begin(_connection);
+            updateUriPrefix();
+            filter["results"][0]["statement_id"] = true;
+            filter["results"][0]["series"][0]["values"] = true;
             lastQuery = millis() - _settings->queryInterval * 1000;
+            _wifiModule = _wifi->registerModule("client");
+            scheduleQuery();
         }
 
         void loop() {
@@ -68,23 +156,53 @@ class InfluxDBClient {
                 // Not configured.
                 return;
             }
-            if (millis() - lastQuery > _settings->queryInterval * 1000) {
+            if (_request.isBusy()) {
+                // The query is in flight. Move it forward without blocking the loop.
+                if (_request.poll()) {
+                    finishQuery();
+                }
+                return;
+            }
+            // Nothing to do while backing off after a failed query, or while the collector has the
+            // shared connection.
+            if (isQueryDue() && _retry.canAttempt() && !_connection->isBusy(&_request)) {
                 // Time for pull. Either the time for that has come or the buffer is getting full.
-                if (!_wifi->isConnected()) {
-                    _wifi->connect();
-                } else {
-                    if (_query(_settings->lookBack)) {
-                        lastQuery = millis();
-                        // Don't disconnect in the first 10 minutes.
-                        if (millis() > 10 * 60 * 1000) {
-                            _wifi->disconnect();
-                        }
-                    }
+                if (_wifi->acquire(_wifiModule)) {
+                    _query(_settings->lookBack);
                 }
             }
         }
 
         void get_config_page(char* buffer) {
+            char status[64];
+            _retry.getStatus(status, sizeof(status));
+            char subscriptions[64];
+            snprintf(
+                subscriptions,
+                sizeof(subscriptions),
+                "%u subscribed, %u fresh",
+                (unsigned int)_subscriptionsCount,
+                (unsigned int)getFreshCount());
+            char history[64];
+            snprintf(
+                history,
+                sizeof(history),
+                "%u values, %lu lookups, %lu fetches",
+                (unsigned int)_historyCount,
+                (unsigned long)_historyLookups,
+                (unsigned long)_historyFetches);
+            char parsing[64];
+            snprintf(
+                parsing,
+                sizeof(parsing),
+                "%u of %u bytes peak, %lu bytes max response",
+                (unsigned int)_peakMemory,
+                (unsigned int)doc.capacity(),
+                (unsigned long)_maxResponse);
+            char connection[64];
+            _connection->getStatus(connection, sizeof(connection));
+            char requests[64];
+            _request.getStatus(requests, sizeof(requests));
             sprintf_P(
                 buffer,
                 INFLUXDB_CLIENT_CONFIG_PAGE,
@@ -93,7 +211,13 @@ class InfluxDBClient {
                 _settings->metric,
                 _settings->srcTag,
                 _settings->queryInterval,
-                _settings->lookBack);
+                _settings->lookBack,
+                status,
+                history,
+                subscriptions,
+                parsing,
+                connection,
+                requests);
         }
 
         void parse_config_params(WebServerBase* webServer, bool& save) {
@@ -103,6 +227,7 @@ class InfluxDBClient {
             webServer->process_setting("ifxc_src", _settings->srcTag, sizeof(_settings->srcTag), save);
             webServer->process_setting("ifxc_qi", _settings->queryInterval, save);
             webServer->process_setting("ifxc_lb", _settings->lookBack, save);
+            updateUriPrefix();
         }
 
         float getQueryResult() {
@@ -120,81 +245,456 @@ class InfluxDBClient {
             dataAvailable = false;
         }
 
-        // Query the data point that has been published X minutes ago.
+        // Fetch the last value of the metric from the src on each query, together with the settings
+        // metric. The strings must stay valid. Returns the subscription id, or -1 if there are
+        // INFLUXDB_MAX_SUBSCRIPTIONS already.
+        int8_t subscribe(const char* metric, const char* src) {
+            if (_subscriptionsCount >= INFLUXDB_MAX_SUBSCRIPTIONS) {
+                _logger->error(LOG_MODULE_INFLUXDB, "Can't subscribe for %s, too many subscriptions", metric);
+                return -1;
+            }
+            InfluxDBSubscription* subscription = &_subscriptions[_subscriptionsCount];
+            memset(subscription, 0, sizeof(InfluxDBSubscription));
+            subscription->metric = metric;
+            subscription->src = src;
+            return _subscriptionsCount++;
+        }
+
+        bool isAvailable(uint8_t id) {
+            return id < _subscriptionsCount && (_subscriptions[id].flags & INFLUXDB_VALUE_AVAILABLE);
+        }
+
+        // The last value fetched for the subscription, even if stale. 0 if there is no value.
+        float getValue(uint8_t id) {
+            return isAvailable(id) ? _subscriptions[id].value : 0;
+        }
+
+        // Time of the data point, in seconds since epoch. 0 if there is no value.
+        uint32_t getTime(uint8_t id) {
+            return isAvailable(id) ? _subscriptions[id].time : 0;
+        }
+
+        // The value is stale if the last query didn't return it, like when nothing was published
+        // in the query window, or if it wasn't refreshed for INFLUXDB_STALE_QUERIES intervals.
+        bool isStale(uint8_t id) {
+            if (!isAvailable(id) || !(_subscriptions[id].flags & INFLUXDB_VALUE_UPDATED)) {
+                return true;
+            }
+            unsigned long maxAge = INFLUXDB_STALE_QUERIES * _settings->queryInterval * 1000UL;
+            return millis() - _subscriptions[id].updatedAt > maxAge;
+        }
+
+        // Query the data point that has been published X minutes ago. The last value of each of
+        // the last INFLUXDB_HISTORY_SIZE minutes is kept locally, so only the newest minutes are
+        // fetched, at most once per INFLUXDB_HISTORY_REFRESH seconds. The older data points are
+        // queried on each call.
         bool query(uint16_t minutesAgo) {
-            return _query(minutesAgo+1, minutesAgo);
+            _historyLookups++;
+            if (minutesAgo + 1 >= INFLUXDB_HISTORY_SIZE) {
+                return queryOlder(minutesAgo);
+            }
+            if (!refreshHistory(minutesAgo + 1)) {
+                return false;
+            }
+
+            uint32_t now = getServerTime();
+            uint32_t from = now - (minutesAgo + 1) * 60;
+            uint32_t to = now - minutesAgo * 60;
+            // The newest minute that overlaps the interval.
+            for (uint8_t i = _historyCount; i > 0; i--) {
+                InfluxDBHistoryEntry* entry = getHistoryEntry(i - 1);
+                if (entry->time + 60 <= from) {
+                    break;
+                }
+                if (entry->time <= to) {
+                    lastDataPoint = entry->value;
+                    dataAvailable = true;
+                    return true;
+                }
+            }
+            return false;
         }
 
     private:
-        /** Get the last data point in the specified interval.
-         * 
+        /** Start the query for the last data point in the specified interval, together with the
+         * subscribed values. The response is handled by finishQuery().
+         *
          * @param notOlderThan Specifies the interval start. The value is processed as now() - X
          *      minutes. Required.
          * @param notNewerThan Specifies the interval end. The value is processed as now() - Y
          *      minutes. Default value is 0 or in other words - look for data up till now.
          */
         bool _query(uint16_t notOlderThan, uint16_t notNewerThan=0) {
+            bool configured = isConfigured();
+            uint8_t count = _subscriptionsCount;
             if (strlen(_settings->address) < 5 ||
                 strlen(_settings->database) == 0 ||
-                strlen(_settings->metric) == 0 ||
-                strlen(_settings->srcTag) == 0) {
-                _logger->log("InfluxDB integration is not configure.");
+                (!configured && count == 0)) {
+                _logger->info(LOG_MODULE_INFLUXDB, "InfluxDB integration is not configure.");
+                queryDone();
                 return false;
             }
-            String url = "";
-            url += _settings->address;
-            url += "/query?db=";
-            url += _settings->database;
-            url += "&q=SELECT+last%28%22value%22%29+FROM+%22";
-            url += _settings->metric;
-            url += "%22+WHERE+time+%3E%3D+now%28%29+-+";
-            url += notOlderThan;
-            url += "m+";
-            if (notNewerThan) {
-                url += "AND+time+%3C%3D+now%28%29+-+";
-                url += notNewerThan;
-                url += "m+";
+            // The settings metric is the first statement, followed by the subscriptions.
+            _uri.reset();
+            uint8_t statements = 0;
+            if (configured) {
+                appendStatement(_settings->metric, _settings->srcTag, notOlderThan, notNewerThan);
+                statements++;
+            }
+            for (uint8_t i = 0; i < count; i++) {
+                if (statements++ > 0) {
+                    _uri.append("%3B");
+                }
+                appendStatement(_subscriptions[i].metric, _subscriptions[i].src, notOlderThan, notNewerThan);
+            }
+
+            return startFetch();
+        }
+
+        void finishQuery() {
+            // The failures are counted by finishFetch(), the next attempt is after the backoff.
+            if (finishFetch()) {
+                // Without data in the window the query is done too, the next one is on the interval.
+                readResults(isConfigured(), _subscriptionsCount);
+                queryDone();
             }
-            url += "AND+%22src%22%3D%27";
-            url += _settings->srcTag;
-            url += "%27";
+        }
 
-            http->begin(url);
-            int statusCode = http->GET();
+        // Delay the next attempt. The query isn't due before the backoff ends, so the WiFi can be
+        // turned off meanwhile.
+        void failed() {
+            _retry.failure();
+            _wifi->schedule(_wifiModule, millis() + _retry.getRetryIn(), 0);
+            releaseNetwork();
+        }
 
+        // The next query is after the interval.
+        void queryDone() {
+            lastQuery = millis();
+            scheduleQuery();
+            releaseNetwork();
+        }
+
+        bool isConfigured() {
+            return strlen(_settings->metric) > 0 && strlen(_settings->srcTag) > 0;
+        }
+
+        // Finish the periodic query if it is in flight. Called before building another query in
+        // _uri, the request keeps the pointer to it for the retry on a stale connection.
+        void completeQuery() {
+            if (_request.isBusy()) {
+                _request.complete();
+                finishQuery();
+            }
+        }
+
+        // Run the query in _uri and parse the response in doc, for the callers that need it right
+        // away.
+        bool fetch() {
+            if (!startFetch()) {
+                return false;
+            }
+            _request.complete();
+            return finishFetch();
+        }
+
+        bool startFetch() {
+            if (_uri.overflowed()) {
+                _logger->error(LOG_MODULE_INFLUXDB, "InfluxDB query doesn't fit in %u bytes", (unsigned int)sizeof(_uriBuffer));
+                // Back off like after a failed request, instead of retrying on each loop.
+                failed();
+                return false;
+            }
+            if (_connection->isBusy(&_request)) {
+                // The collector has the shared connection. Not a failure, the caller can try again.
+                return false;
+            }
+            if (_request.start(_settings->address, "GET", _uri.c_str())) {
+                return true;
+            }
+            finishFetch();
+            return false;
+        }
+
+        // Parse the response of the request started by startFetch().
+        bool finishFetch() {
+            int statusCode = _request.getStatusCode();
             bool success = statusCode == 200;
+            bool reusable = success;
             if (success) {
-                deserializeJson(*doc, http->getString());
-                if ((*doc)["results"][0].containsKey("series")) {
-                    lastDataPoint = (*doc)["results"][0]["series"][0]["values"][0][1];
-                    const char* ts = (*doc)["results"][0]["series"][0]["values"][0][0];
-                    _logger->log("Got %.2f at %s", lastDataPoint, ts);
-                    dataAvailable = true;
-                    // _logger->log("[ifc] Got %.1f at %s",
-                    //     (*doc)["results"][0]["series"][0]["values"][0][1],
-                    //     (*doc)["results"][0]["series"][0]["values"][0][0]);
-                } else {
+                uint32_t serverTime = HttpConnection::parseDate(_request.getDate());
+                if (serverTime != 0) {
+                    _serverTime = serverTime;
+                    _serverTimeAt = millis();
+                }
+
+                // Parse the response straight from the connection, keeping only the values. The
+                // memory used doesn't depend on the response size.
+                HttpBodyStream body = _request.getBody();
+                DeserializationError error = deserializeJson(doc, body, DeserializationOption::Filter(filter));
+                reusable = body.skip();
+                _peakMemory = max(_peakMemory, doc.memoryUsage());
+                _maxResponse = max(_maxResponse, body.getBytesRead());
+
+                if (error) {
                     success = false;
-                    _logger->log("InfluxDB response with no data.");
+                    _logger->warn(LOG_MODULE_INFLUXDB, "Can't parse InfluxDB response: %s", error.c_str());
+                } else if (doc.overflowed()) {
+                    success = false;
+                    _logger->warn(LOG_MODULE_INFLUXDB, "InfluxDB response doesn't fit in %u bytes", (unsigned int)doc.capacity());
                 }
             } else {
-                _logger->log("Query for %s failed with HTTP %d", url.c_str(), statusCode);
-                _wifi->disconnect();
-                _wifi->connect();
+                _logger->warn(LOG_MODULE_INFLUXDB, "InfluxDB query failed with HTTP %d", statusCode);
             }
 
-            http->end();
+            if (success) {
+                _retry.success();
+            } else {
+                failed();
+            }
+
+            _request.end(reusable);
             return success;
         }
 
+        void appendStatement(const char* metric, const char* src, uint16_t notOlderThan, uint16_t notNewerThan) {
+            _uri.append("SELECT+last%28%22value%22%29+FROM+%22").appendEncoded(metric, '"');
+            _uri.append("%22+WHERE+time+%3E%3D+now%28%29+-+").append(notOlderThan).append("m+");
+            if (notNewerThan) {
+                _uri.append("AND+time+%3C%3D+now%28%29+-+").append(notNewerThan).append("m+");
+            }
+            _uri.append("AND+%22src%22%3D%27").appendEncoded(src, '\'').append("%27");
+        }
+
+        // The uri up to the query depends only on the settings, so it is built once they change.
+        void updateUriPrefix() {
+            _uri.clear();
+            _uri.append("/query?db=").appendEncoded(_settings->database).append("&epoch=s&q=");
+            _uri.mark();
+        }
+
+        // Store the values from the parsed response. The statements without data have no series.
+        // Returns false if the settings metric has no data.
+        bool readResults(bool configured, uint8_t count) {
+            for (uint8_t i = 0; i < count; i++) {
+                _subscriptions[i].flags &= ~INFLUXDB_VALUE_UPDATED;
+            }
+
+            bool found = false;
+            unsigned long now = millis();
+            JsonArray results = doc["results"];
+            for (size_t i = 0; i < results.size(); i++) {
+                JsonVariant values = results[i]["series"][0]["values"][0];
+                if (values.isNull()) {
+                    continue;
+                }
+                uint8_t statement = results[i]["statement_id"];
+                uint32_t time = values[0];
+                float value = values[1];
+                if (configured && statement == 0) {
+                    lastDataPoint = value;
+                    dataAvailable = true;
+                    found = true;
+                    _logger->debug(LOG_MODULE_INFLUXDB, "Got %.2f at %lu", lastDataPoint, (unsigned long)time);
+                    continue;
+                }
+
+                uint8_t id = configured ? statement - 1 : statement;
+                if (id < count) {
+                    _subscriptions[id].value = value;
+                    _subscriptions[id].time = time;
+                    _subscriptions[id].updatedAt = now;
+                    _subscriptions[id].flags |= INFLUXDB_VALUE_AVAILABLE | INFLUXDB_VALUE_UPDATED;
+                }
+            }
+
+            if (configured && !found) {
+                _logger->info(LOG_MODULE_INFLUXDB, "InfluxDB response with no data.");
+                return false;
+            }
+            return true;
+        }
+
+        // The last data point in the interval, for the minutes before the history.
+        bool queryOlder(uint16_t minutesAgo) {
+            if (strlen(_settings->address) < 5 ||
+                strlen(_settings->database) == 0 ||
+                !isConfigured()) {
+                _logger->info(LOG_MODULE_INFLUXDB, "InfluxDB integration is not configure.");
+                return false;
+            }
+
+            completeQuery();
+            _uri.reset();
+            appendStatement(_settings->metric, _settings->srcTag, minutesAgo + 1, minutesAgo);
+            if (!fetch()) {
+                return false;
+            }
+            JsonVariant values = doc["results"][0]["series"][0]["values"][0];
+            if (values.isNull()) {
+                return false;
+            }
+            lastDataPoint = values[1];
+            dataAvailable = true;
+            return true;
+        }
+
+        // Make sure the history covers the last minutes. Fetches everything if the cached minutes
+        // don't go back far enough, otherwise only the minutes since the overlap. Each row of the
+        // response is the last value of a minute, so the rows fit in the history regardless of
+        // how often the metric is published.
+        bool refreshHistory(uint16_t minutes) {
+            if (strlen(_settings->address) < 5 ||
+                strlen(_settings->database) == 0 ||
+                strlen(_settings->metric) == 0 ||
+                strlen(_settings->srcTag) == 0) {
+                _logger->info(LOG_MODULE_INFLUXDB, "InfluxDB integration is not configure.");
+                return false;
+            }
+
+            bool fetched = _historyFetchedAt != 0 && _serverTime != 0;
+            if (fetched && getServerTime() - minutes * 60 >= _historyFrom &&
+                millis() - _historyFetchedAt < INFLUXDB_HISTORY_REFRESH * 1000UL) {
+                return true;
+            }
+
+            completeQuery();
+
+            // Re-fetch everything if the history doesn't go back far enough, otherwise the tail
+            // from the start of a minute, so the minutes fetched again are complete. After a gap
+            // longer than the history the tail wouldn't fit in the response, so everything is
+            // fetched too.
+            uint32_t since = _historyTo - min(_historyTo, (uint32_t)INFLUXDB_HISTORY_OVERLAP);
+            since -= since % 60;
+            bool full = !fetched ||
+                getServerTime() - minutes * 60 < _historyFrom ||
+                getServerTime() - since >= (INFLUXDB_HISTORY_SIZE - 1) * 60UL;
+            _uri.reset();
+            _uri.append("SELECT+last%28%22value%22%29+FROM+%22").appendEncoded(_settings->metric, '"');
+            _uri.append("%22+WHERE+time+");
+            if (full) {
+                _uri.append("%3E+now%28%29+-+").append(minutes).append("m");
+            } else {
+                _uri.append("%3E%3D+").append(since).append("s");
+            }
+            _uri.append("+AND+%22src%22%3D%27").appendEncoded(_settings->srcTag, '\'');
+            _uri.append("%27+GROUP+BY+time%281m%29+fill%28none%29");
+
+            _historyFetches++;
+            if (!fetch() || _serverTime == 0) {
+                return false;
+            }
+
+            if (full) {
+                _historyCount = 0;
+                _historyFrom = _serverTime - minutes * 60;
+            } else {
+                // Drop the minutes that are fetched again.
+                while (_historyCount > 0 && getHistoryEntry(_historyCount - 1)->time >= since) {
+                    _historyCount--;
+                }
+            }
+
+            // The rows are oldest first.
+            JsonArray values = doc["results"][0]["series"][0]["values"];
+            for (size_t i = 0; i < values.size(); i++) {
+                appendHistory(values[i][0], values[i][1]);
+            }
+            _historyTo = _serverTime;
+            _historyFetchedAt = millis();
+            return true;
+        }
+
+        void appendHistory(uint32_t time, float value) {
+            if (_historyCount >= INFLUXDB_HISTORY_SIZE) {
+                // Drop the oldest minute, the history doesn't cover it anymore.
+                _historyFrom = max(_historyFrom, getHistoryEntry(0)->time + 60);
+                _historyStart = (_historyStart + 1) % INFLUXDB_HISTORY_SIZE;
+                _historyCount--;
+            }
+            InfluxDBHistoryEntry* entry = &_history[(_historyStart + _historyCount) % INFLUXDB_HISTORY_SIZE];
+            entry->time = time;
+            entry->value = value;
+            _historyCount++;
+        }
+
+        // The history entry by index, from the oldest one.
+        InfluxDBHistoryEntry* getHistoryEntry(uint8_t index) {
+            return &_history[(_historyStart + index) % INFLUXDB_HISTORY_SIZE];
+        }
+
+        // The server time, based on the Date header of the last response, in seconds since epoch.
+        uint32_t getServerTime() {
+            return _serverTime + (millis() - _serverTimeAt) / 1000;
+        }
+
+        uint8_t getFreshCount() {
+            uint8_t fresh = 0;
+            for (uint8_t i = 0; i < _subscriptionsCount; i++) {
+                if (!isStale(i)) {
+                    fresh++;
+                }
+            }
+            return fresh;
+        }
+
+        // Release the WiFi lease. The WiFi is kept on in the first 10 minutes.
+        void releaseNetwork() {
+            bool disconnect = millis() > 10 * 60 * 1000;
+            if (disconnect) {
+                _connection->stop();
+            }
+            _wifi->release(_wifiModule, disconnect);
+        }
+
+        // The next query is due after the query interval. It can be done up to a quarter of the
+        // interval earlier, if the WiFi is on for another module anyway.
+        void scheduleQuery() {
+            unsigned long interval = _settings->queryInterval * 1000UL;
+            _wifi->schedule(_wifiModule, lastQuery + interval, interval / 4);
+        }
+
+        bool isQueryDue() {
+            if (_wifiModule != WIFI_NO_MODULE) {
+                return _wifi->isDue(_wifiModule);
+            }
+            return millis() - lastQuery > _settings->queryInterval * 1000;
+        }
+
         unsigned long lastQuery;
-        HTTPClient* http = NULL;
-        DynamicJsonDocument *doc;
+        StaticJsonDocument<(JSON_DOC_CAPACITY > JSON_HISTORY_CAPACITY ? JSON_DOC_CAPACITY : JSON_HISTORY_CAPACITY)> doc;
+        StaticJsonDocument<JSON_FILTER_CAPACITY> filter;
+        size_t _peakMemory = 0;
+        uint32_t _maxResponse = 0;
 
         Logger* _logger = NULL;
         WiFiManager* _wifi = NULL;
+        uint8_t _wifiModule = WIFI_NO_MODULE;
         InfluxDBClientSettings* _settings = NULL;
         NetworkSettings* _networkSettings = NULL;
+        HttpConnection* _connection = NULL;
+        AsyncHttpRequest _request;
+        char _uriBuffer[INFLUXDB_CLIENT_URI_SIZE];
+        UrlBuilder _uri;
+
+        RetryPolicy _retry;
+
+        // Ring of the last values of the settings metric in the past minutes, oldest first. The
+        // minutes without data are skipped. The values cover the time from _historyFrom to
+        // _historyTo.
+        InfluxDBHistoryEntry _history[INFLUXDB_HISTORY_SIZE];
+        uint8_t _historyStart = 0;
+        uint8_t _historyCount = 0;
+        uint32_t _historyFrom = 0;
+        uint32_t _historyTo = 0;
+        unsigned long _historyFetchedAt = 0;
+        uint32_t _historyLookups = 0;
+        uint32_t _historyFetches = 0;
+        uint32_t _serverTime = 0;
+        unsigned long _serverTimeAt = 0;
+
+        InfluxDBSubscription _subscriptions[INFLUXDB_MAX_SUBSCRIPTIONS];
+        uint8_t _subscriptionsCount = 0;
 
         bool dataAvailable = false;
         float lastDataPoint = -1;
@@ -2,13 +2,31 @@
 
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 
-#include <ESP8266HTTPClient.h>
-
 #include "Logger.h"
 #include "WiFi.h"
 #include "WebServerBase.h"
+#include "TelemetryBuffer.h"
+#include "SeriesStore.h"
+#include "TelemetryAggregator.h"
+#include "TelemetryDeadband.h"
+#include "TelemetrySpool.h"
+#include "RetryPolicy.h"
+#include "DriftClock.h"
+#include "HttpConnection.h"
+#include "AsyncHttpRequest.h"
+#include "HttpTransport.h"
+#include "UdpTransport.h"
+#include "RTCSampleLog.h"
 #include <WiFiClient.h>
 
+// Define TELEMETRY_SERIES_STORE to keep the collected data Gorilla compressed. Takes more CPU on
+// append and push, but fits many times more samples in the same RAM.
+#ifdef TELEMETRY_SERIES_STORE
+typedef SeriesStore TelemetryStore;
+#else
+typedef TelemetryBuffer TelemetryStore;
+#endif
+
 const char INFLUXDB_CONFIG_PAGE[] PROGMEM = R"=====(
 <fieldset style='display: inline-block; width: 300px'>
 <legend>InfluxDB settings</legend>
@@ -29,12 +47,91 @@ Collect interval:<br>
 Push interval:<br>
 <input type="text" name="ifx_push" value="%d"><br>
 <small><em>in seconds, from 0 to 65535</em></small><br><br>
+Aggregation window:<br>
+<input type="text" name="ifx_window" value="%d"><br>
+<small><em>in seconds, 0 to push each collected value</em></small><br><br>
+Push mode:<br>
+<select name="ifx_push_mode">
+<option value="0" %s>Batched requests</option>
+<option value="1" %s>Single chunked request</option>
+<option value="2" %s>Single chunked gzip request</option>
+<option value="3" %s>UDP datagrams</option>
+</select><br>
+<small><em>chunked streams the whole buffer in one request</em></small><br><br>
+UDP port:<br>
+<input type="text" name="ifx_udp_port" value="%d"><br>
+<small><em>of the InfluxDB UDP listener on the same host, 8089 if 0. The listener needs precision = "s"</em></small><br><br>
+Deep sleep between collects:<br>
+<select name="ifx_deep_sleep">
+<option value="true" %s>Enabled</option>
+<option value="false" %s>Disabled</option>
+</select><br>
+<small><em>requires GPIO16 connected to RST, the web UI is available only while pushing</em></small><br><br>
+SNTP server:<br>
+<input type="text" name="ifx_ntp" value="%s"><br>
+<small><em>optional, the InfluxDB time is used if empty</em></small><br><br>
+Status:<br>
+<small><em>%s</em></small><br>
+Clock:<br>
+<small><em>%s</em></small><br>
+Connection:<br>
+<small><em>%s</em></small><br>
+Requests:<br>
+<small><em>%s</em></small><br>
+Transport:<br>
+<small><em>%s<br>%s</em></small><br>
 </fieldset>
 )=====";
 
-// Size of the in-memory buffer. The bigger, the better. But consider the available RAM.
-#ifndef TELEMETRY_BUFFER_SIZE
-#define TELEMETRY_BUFFER_SIZE 24 * 1024
+// Size of the buffer used for rendering the line protocol on push. Each push is split in HTTP
+// requests of up to that size.
+#ifndef TELEMETRY_PUSH_BUFFER_SIZE
+#define TELEMETRY_PUSH_BUFFER_SIZE 2 * 1024
+#endif
+
+// The request moved forward by loop().
+#define INFLUXDB_REQUEST_NONE 0
+#define INFLUXDB_REQUEST_PING 1
+#define INFLUXDB_REQUEST_PUSH 2
+#define INFLUXDB_REQUEST_SPOOL 3
+
+// Maximum data uploaded from the spool on a single loop() call.
+#ifndef TELEMETRY_SPOOL_UPLOAD_SIZE
+#define TELEMETRY_SPOOL_UPLOAD_SIZE 8 * 1024
+#endif
+
+// Each batch of up to TELEMETRY_PUSH_BUFFER_SIZE bytes is pushed in separate HTTP request.
+#define PUSH_MODE_BATCHED 0
+// The whole buffer is streamed as a single HTTP request with chunked transfer encoding.
+#define PUSH_MODE_CHUNKED 1
+// Same as PUSH_MODE_CHUNKED, but the body is gzip compressed.
+#define PUSH_MODE_CHUNKED_GZIP 2
+// UDP datagrams to the InfluxDB UDP listener. No delivery confirmation.
+#define PUSH_MODE_UDP 3
+
+// Default port of the InfluxDB UDP listener.
+#define INFLUXDB_UDP_PORT 8089
+
+// Maximum estimated clock error in deep sleep mode, in milliseconds. The clock is synced once it
+// is exceeded.
+#ifndef DEEP_SLEEP_MAX_TIME_ERROR
+#define DEEP_SLEEP_MAX_TIME_ERROR 60 * 1000UL
+#endif
+
+// Accuracy of the deep sleep duration, in percent. The RTC timer is far less accurate than the
+// crystal.
+#ifndef DEEP_SLEEP_TIME_ERROR
+#define DEEP_SLEEP_TIME_ERROR 2
+#endif
+
+// Maximum time to stay awake for connecting and pushing in deep sleep mode, in milliseconds.
+#ifndef DEEP_SLEEP_MAX_AWAKE
+#define DEEP_SLEEP_MAX_AWAKE 30 * 1000UL
+#endif
+
+// Maximum delay of the next push attempt after failures in deep sleep mode, in seconds.
+#ifndef DEEP_SLEEP_MAX_BACKOFF
+#define DEEP_SLEEP_MAX_BACKOFF 60 * 60UL
 #endif
 
 struct InfluxDBCollectorSettings {
@@ -43,8 +140,16 @@ struct InfluxDBCollectorSettings {
     char database[16];
     uint16_t pushInterval;
     uint16_t collectInterval;
+    uint8_t pushMode;
+    uint16_t aggregationWindow;
+    char ntpServer[32];
+    uint16_t udpPort;
+    bool deepSleep;
 };
 
+static_assert(24 + 3 * sizeof(InfluxDBCollectorSettings::database) <= HTTP_TRANSPORT_URI_SIZE,
+              "The write uri doesn't fit the database name");
+
 class InfluxDBCollector {
     public:
         // Check if data is ready to be collected.
@@ -64,17 +169,35 @@ class InfluxDBCollector {
         InfluxDBCollector(Logger* _logger,
                           WiFiManager* _wifi,
                           InfluxDBCollectorSettings* settings,
-                          NetworkSettings* networkSettings) {
+                          NetworkSettings* networkSettings,
+                          TelemetrySpool* spool=NULL,
+                          HttpConnection* connection=NULL) : telemetry(networkSettings->hostname),
+                                                      _http(_logger, pushBuffer, sizeof(pushBuffer)),
+                                                      _udp(_logger, pushBuffer, sizeof(pushBuffer)) {
             this->_logger = _logger;
             this->_wifi = _wifi;
             this->_settings = settings;
             this->_networkSettings = networkSettings;
+            this->_spool = spool;
+            this->_connection = connection;
         }
 
         void begin() {
-            http = new HTTPClient();
-            const char * headerKeys[] = {"date"};
-            http->collectHeaders(headerKeys, 1);
+            if (_connection == NULL) {
+                _connection = new HttpConnection(_logger);
+            }
+            _connection->begin();
+            _request.begin(_connection);
+            _http.begin(_connection, &_request);
+            updateTarget();
+
+            if (_spool != NULL) {
+                _spool->begin();
+            }
+
+            if (_wifi != NULL) {
+                _wifiModule = _wifi->registerModule("collector");
+            }
         }
 
         void loop() {
@@ -85,44 +208,64 @@ class InfluxDBCollector {
                 return;
             }
 
-            // Get the remote time stamp every 24 hours.
-            if (remoteTimestamp == 0 || (millis() - remoteTimestampMillis) > 24 * 60 * 60 * 1000) {
-                if (_wifi != NULL && !_wifi->isConnected()) {
-                    _wifi->connect();
-                } else {
-                    ping();
-                    // Don't disconnect in the first 30 minutes.
-                    if (_wifi != NULL && millis() > 30 * 60 * 1000) {
-                        _wifi->disconnect();
-                    }
-                }
+            if (_settings->deepSleep) {
+                deepSleepLoop();
+                return;
             }
 
-            // TODO: delay further push attempts with 1 minute. Currently if there is an issue with
-            // the InfluxDB the microcontroller keeps a constant loop of disconnet, connect, httpp
-            // call untill the data is pushed.
-            if (millis() - lastDataPush > _settings->pushInterval * 1000 ||
-                telemetryDataSize >= 0.80f * TELEMETRY_BUFFER_SIZE ||
-                shouldPush()) {
-                // Time for push. Either the time for that has come or the buffer is getting full.
-                if (_wifi != NULL && !_wifi->isConnected()) {
-                    _wifi->connect();
-                } else {
-                    if (push()) {
-                        lastDataPush = millis();
-                        // Don't disconnect in the first 30 minutes.
-                        if (_wifi != NULL && millis() > 30 * 60 * 1000) {
-                            _wifi->disconnect();
+            if (_pending != INFLUXDB_REQUEST_NONE) {
+                // A request is in flight. Move it forward without blocking the loop, the samples
+                // are collected meanwhile.
+                if (_request.poll()) {
+                    finishPending();
+                }
+            } else if (_connection->isBusy(&_request)) {
+                // Another component has the shared connection, like the InfluxDBClient query.
+            } else if (_retry.canAttempt()) {
+                // Nothing to do while backing off after a failure, the WiFi is kept off meanwhile.
+                // Sync the clock once it is due, every 24 hours until the drift is measured. A half
+                // open circuit is probed with the same cheap ping request.
+                if (_clock.needsSync() || _retry.isHalfOpen()) {
+                    if (!acquireNetwork()) {
+                        // Waiting for the connection.
+                    } else if (syncNtp()) {
+                        releaseNetwork();
+                    } else {
+                        startPending(INFLUXDB_REQUEST_PING);
+                    }
+                } else if (isPushDue() ||
+                           telemetry.size() >= 0.80f * telemetry.capacity() ||
+                           shouldPush()) {
+                    // Time for push. Either the time for that has come or the buffer is getting full.
+                    bool batched = _transport == NULL && _settings->pushMode == PUSH_MODE_BATCHED;
+                    if (!acquireNetwork()) {
+                        // Waiting for the connection.
+                    } else if (_spool != NULL && !_spool->isEmpty()) {
+                        // The spooled data is older, push it first. Bounded amount on each loop() call.
+                        if (batched) {
+                            startPending(INFLUXDB_REQUEST_SPOOL);
+                        } else {
+                            pushSpool();
                         }
+                    } else if (batched) {
+                        beforePush();
+                        startPending(INFLUXDB_REQUEST_PUSH);
+                    } else if (push()) {
+                        pushed();
                     }
                 }
             }
 
+            // Push the statistics for the passed aggregation window.
+            if (_aggregator.size() > 0 && millis() - windowStart > _settings->aggregationWindow * 1000) {
+                flushAggregates();
+            }
+
             // Collect if all of the following is true:
             // 1) The time for that has come.
             // 2) The "shouldCollect" returns true.
             // 3) The timestamp is initialized.
-            if (remoteTimestamp > 0 &&
+            if (_clock.isSet() &&
                 millis() - lastDataCollect > _settings->collectInterval * 1000 &&
                 shouldCollect()) {
                 collectData();
@@ -131,38 +274,109 @@ class InfluxDBCollector {
         }
 
         void append(const char* metric, float value, uint8_t precision=0) {
-            char format[32];
-            int metricSize = 0;
-            if (remoteTimestamp > 0) {
-                sprintf(format, "%%s,src=%%s value=%%.%df %%ld\n", precision);
-                metricSize = snprintf(
-                    telemetryData + telemetryDataSize,
-                    TELEMETRY_BUFFER_SIZE - telemetryDataSize,
-                    format,
-                    metric,
-                    _networkSettings->hostname,
-                    value,
-                    getTimestamp());
-            } else {
-                // Same as above, but without a timestamp. In this case the timestamp for the metric will
-                // be the current time when they are send to the InfluxDB.
-                sprintf(format, "%%s,src=%%s value=%%.%df\n", precision);
-                metricSize = snprintf(
-                    telemetryData + telemetryDataSize,
-                    TELEMETRY_BUFFER_SIZE - telemetryDataSize,
-                    format,
-                    metric,
-                    _networkSettings->hostname,
-                    value);
-            }
-
-            if (telemetryDataSize + metricSize > TELEMETRY_BUFFER_SIZE) {
-                // In that case - we don't have the whole metric line in the buffer.
-                telemetryData[telemetryDataSize] = '\0';
-                _logger->log("Telemetry buffer overflow!");
-            } else {
-                telemetryDataSize += metricSize;
+            // In deep sleep mode the samples are kept in the RTC memory. The aggregation and the
+            // deadband need state that doesn't survive the deep sleep, so they don't apply.
+            if (_settings->deepSleep) {
+                if (!_clock.isSet() || !_rtcLog.append(metric, value, precision, getTimestamp())) {
+                    appendSample(metric, value, precision);
+                }
+                return;
+            }
+
+            // With aggregation the value is only added to the window statistics. If there are too
+            // many metrics to aggregate, it is recorded as is.
+            if (_settings->aggregationWindow > 0) {
+                if (_aggregator.size() == 0) {
+                    windowStart = millis();
+                }
+                if (_aggregator.add(metric, value, precision)) {
+                    return;
+                }
+            }
+
+            if (!_deadband.shouldRecord(metric, value)) {
+                return;
+            }
+
+            appendSample(metric, value, precision);
+        }
+
+        void appendSample(const char* metric, float value, uint8_t precision) {
+            // Without a timestamp the time for the metric will be the current time when it is send
+            // to the InfluxDB.
+            uint32_t timestamp = _clock.isSet() ? getTimestamp() : 0;
+            if (telemetry.append(metric, value, precision, timestamp)) {
+                return;
+            }
+
+            // The buffer is full. Move its data to the spool, if there is one.
+            if (spill() && telemetry.append(metric, value, precision, timestamp)) {
+                return;
             }
+            _logger->warn(LOG_MODULE_INFLUXDB, "Telemetry buffer overflow!");
+        }
+
+        // Push synchronously with a custom transport instead of the push mode, NULL restores it.
+        void setTransport(TelemetryTransport* transport) {
+            _transport = transport;
+        }
+
+        // Record the metric only when it changes by more than the threshold, or when nothing has
+        // been recorded for the heartbeat time, in seconds. With relative deadband the threshold
+        // is a fraction of the last recorded value, like 0.05 for 5%. Applies to append() without
+        // aggregation.
+        void setDeadband(const char* metric,
+                         float threshold,
+                         bool relative=false,
+                         uint16_t heartbeat=TELEMETRY_DEADBAND_HEARTBEAT) {
+            if (!_deadband.set(metric, threshold, relative, heartbeat)) {
+                _logger->error(LOG_MODULE_INFLUXDB, "Can't set deadband for %s", metric);
+            }
+        }
+
+        // Start a point with multiple fields. All fields are pushed as a single line with the same
+        // timestamp, like 'climate,src=host,room=kitchen temp=21.5,hum=45 1544254697':
+        //   beginPoint("climate", "room=kitchen");
+        //   addField("temp", 21.5, 1);
+        //   addField("hum", 45);
+        //   endPoint();
+        // The tags are optional. The names should stay valid until endPoint() is called.
+        void beginPoint(const char* measurement, const char* tags=NULL) {
+            pointMeasurement = measurement;
+            pointTags = tags;
+            pointFieldsCount = 0;
+        }
+
+        void addField(const char* field, float value, uint8_t precision=0) {
+            if (pointMeasurement == NULL || pointFieldsCount >= TELEMETRY_MAX_POINT_FIELDS) {
+                _logger->error(LOG_MODULE_INFLUXDB, "Can't add field %s", field);
+                return;
+            }
+            pointFields[pointFieldsCount].name = field;
+            pointFields[pointFieldsCount].value = value;
+            pointFields[pointFieldsCount].precision = precision;
+            pointFieldsCount++;
+        }
+
+        void endPoint() {
+            if (pointMeasurement == NULL) {
+                return;
+            }
+
+            appendPoint(pointMeasurement, pointTags, pointFields, pointFieldsCount);
+            pointMeasurement = NULL;
+        }
+
+        // Append a point for each aggregated metric, like
+        // 'temp,src=host min=21.2,max=21.9,mean=21.53,last=21.4,count=60 1544254697', and start a
+        // new window.
+        void flushAggregates() {
+            TelemetryField fields[TELEMETRY_AGGREGATE_FIELDS];
+            for (uint8_t i = 0; i < _aggregator.size(); i++) {
+                uint8_t count = _aggregator.getFields(i, fields);
+                appendPoint(_aggregator.getMetric(i), NULL, fields, count);
+            }
+            _aggregator.clear();
         }
 
         void stop() {
@@ -172,9 +386,15 @@ class InfluxDBCollector {
 
             enabled = false;
 
-            if (telemetryDataSize > 0) {
+            flushAggregates();
+            while (_pending != INFLUXDB_REQUEST_NONE) {
+                _request.complete();
+                finishPending();
+            }
+            if (!telemetry.isEmpty() && !_connection->isBusy(&_request)) {
                 // The stop can be invoked only if the settings get changed. In this case the WiFi should
-                // be up and running.
+                // be up and running. If another component has the connection, the data stays in the
+                // buffer till the collector is enabled again.
                 push();
             }
         }
@@ -188,10 +408,30 @@ class InfluxDBCollector {
 
             lastDataCollect = millis() - _settings->collectInterval * 1000;
             lastDataPush = millis();
-            remoteTimestamp = 0;
+            schedulePush();
+            _aggregator.clear();
+            _deadband.reset();
         }
 
         void get_config_page(char* buffer) {
+            char status[128];
+            _retry.getStatus(status, sizeof(status));
+            char clock[48];
+            _clock.getStatus(clock, sizeof(clock));
+            char connection[64];
+            _connection->getStatus(connection, sizeof(connection));
+            char requests[64];
+            _request.getStatus(requests, sizeof(requests));
+            char httpStats[80];
+            _http.stats.getStatus("HTTP", httpStats, sizeof(httpStats));
+            char udpStats[80];
+            _udp.stats.getStatus("UDP", udpStats, sizeof(udpStats));
+            size_t length = strlen(status);
+            snprintf(
+                status + length,
+                sizeof(status) - length,
+                ", %lu values suppressed by deadband",
+                (unsigned long)_deadband.getSuppressed());
             sprintf_P(
                 buffer,
                 INFLUXDB_CONFIG_PAGE,
@@ -200,7 +440,22 @@ class InfluxDBCollector {
                 _settings->address,
                 _settings->database,
                 _settings->collectInterval,
-                _settings->pushInterval);
+                _settings->pushInterval,
+                _settings->aggregationWindow,
+                (_settings->pushMode == PUSH_MODE_BATCHED)?"selected":"",
+                (_settings->pushMode == PUSH_MODE_CHUNKED)?"selected":"",
+                (_settings->pushMode == PUSH_MODE_CHUNKED_GZIP)?"selected":"",
+                (_settings->pushMode == PUSH_MODE_UDP)?"selected":"",
+                _settings->udpPort,
+                (_settings->deepSleep)?"selected":"",
+                (!_settings->deepSleep)?"selected":"",
+                _settings->ntpServer,
+                status,
+                clock,
+                connection,
+                requests,
+                httpStats,
+                udpStats);
         }
 
         void parse_config_params(WebServerBase* webServer) {
@@ -209,135 +464,441 @@ class InfluxDBCollector {
             webServer->process_setting("ifx_db", _settings->database, sizeof(_settings->database));
             webServer->process_setting("ifx_collect", _settings->collectInterval);
             webServer->process_setting("ifx_push", _settings->pushInterval);
+            webServer->process_setting("ifx_push_mode", _settings->pushMode);
+            webServer->process_setting("ifx_udp_port", _settings->udpPort);
+            webServer->process_setting("ifx_deep_sleep", _settings->deepSleep);
+            webServer->process_setting("ifx_window", _settings->aggregationWindow);
+            webServer->process_setting("ifx_ntp", _settings->ntpServer, sizeof(_settings->ntpServer));
+            updateTarget();
         }
 
     // private:
         // Sync the local timestamp based on the date/time response from the InfluxDB server. This
         // is needed in order to append the proper timestamps to the metrics beeing generated.
         void syncTime(const char* dateTime) {
-            if (strlen(dateTime) != 29) {
-                // Something's wrong. The datetime should be 29 characters.
-                _logger->log("Failed to parse the InfluxDB date/time: %s", dateTime);
+            uint32_t timestamp = HttpConnection::parseDate(dateTime);
+            if (timestamp == 0) {
+                _logger->warn(LOG_MODULE_INFLUXDB, "Failed to parse the InfluxDB date/time: %s", dateTime);
                 return;
             }
-            // Get the millis when the remote date was received.
-            remoteTimestampMillis = millis();
-
-            // Calculate the timestamp from a date/time string as "Sat, 08 Dec 2018 07:38:17 GMT". Based on
-            // the "Seconds Since the Epoch" formula as defined by POSIX:2008 section 4.15. The following
-            // are the required parameters:
-            int16_t tm_sec = atoi(dateTime+23);         // seconds
-            int16_t tm_min = atoi(dateTime+20);         // minutes
-            int16_t tm_hour = atoi(dateTime+17);        // hours
-            int16_t tm_year = atoi(dateTime+12) - 1900; // calendar year minus 1900
-            int16_t tm_yday;                            // passed days since January 1 of the current year
-
-            // tm_yday is calculated based on the month, the day and on the year (leap/non-leap).
-
-            // Day in current month
-            int16_t day = atoi(dateTime+5);
-
-            // Convert month to number. 1 for January, 12 for December.
-            const char* months[12] = {
-                "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
-            };
-            int16_t month = 1;
-            while (strncmp(dateTime + 8, months[month-1], 3) != 0 && month < 13) {
-                month++;
-            }
-
-            // Determine if the year is leap or not.
-            bool isLeapYear = false;
-            if ((tm_year + 1900) % 4 == 0 )
-                isLeapYear = true;
-            if ((tm_year + 1900) % 100 == 0 )
-                isLeapYear = false;
-            if ((tm_year + 1900) % 400 == 100 )
-                isLeapYear = true;
-
-            // Calculate the number of passed days before the current month.
-            int16_t days_before_month[2][13] = {
-                /* Normal years.  */
-                {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365},
-                /* Leap years.  */
-                {0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335, 366}
-            };
-
-            // Calculate the full days that have passed since the year start.
-            tm_yday = days_before_month[isLeapYear][month-1] + day-1;
-
-            remoteTimestamp =
-                tm_sec + tm_min*60 +
-                tm_hour*3600 +
-                tm_yday*86400 +
-                (tm_year-70)*31536000 +
-                ((tm_year-69)/4)*86400 -
-                ((tm_year-1)/100)*86400 +
-                ((tm_year+299)/400)*86400;
+
+            // The date has one second resolution, the actual time is anywhere within that second.
+            _clock.sync(timestamp * 1000ULL + 500, 500);
         }
 
         unsigned long getTimestamp() {
-            // The below would be correct even if the millis() have rolled over. The only
-            // requirement for this to work is to have the last timestamp retrieved before not more
-            // than the millis rollover period that is ~50 days.
-            unsigned long secondsSinceTimestampRetrieval = (millis() - remoteTimestampMillis) / 1000;
+            return _clock.now();
+        }
 
-            return remoteTimestamp + secondsSinceTimestampRetrieval;
+        // Sync the clock with the SNTP server, if there is one, falling back to the InfluxDB time.
+        bool sync() {
+            return syncNtp() || ping();
+        }
+
+        // Sync the clock with the SNTP server. Returns false if there is none or the sync fails.
+        bool syncNtp() {
+            if (_settings->ntpServer[0] == '\0' || _retry.isHalfOpen()) {
+                return false;
+            }
+            if (_clock.syncNtp(_settings->ntpServer)) {
+                return true;
+            }
+            _logger->warn(LOG_MODULE_INFLUXDB, "SNTP sync with %s failed", _settings->ntpServer);
+            return false;
         }
 
         // Executed with only purpose to get the current timestamp of the IndluxDB.
-        void ping() {
-            String url = "";
-            url += _settings->address;
-            url += "/ping";
-            http->begin(this->_wifiClient, url);
-            int httpCode = http->GET();
-            if (httpCode == 204) {
-                syncTime(http->header("date").c_str());
+        bool ping() {
+            if (_request.start(_settings->address, "GET", "/ping")) {
+                _request.complete();
+            }
+            return finishPing();
+        }
+
+        bool finishPing() {
+            int statusCode = _request.getStatusCode();
+            bool success = statusCode == 204;
+            if (success) {
+                syncTime(_request.getDate());
+                _retry.success();
+            }
+            _request.end(success);
+
+            if (!success) {
+                _logger->warn(LOG_MODULE_INFLUXDB, "Ping failed with HTTP %d", statusCode);
+                failed();
+            }
+            return success;
+        }
+
+        // Start a ping or a batched push, moved forward by loop().
+        void startPending(uint8_t request) {
+            if (request == INFLUXDB_REQUEST_PING) {
+                if (_request.start(_settings->address, "GET", "/ping")) {
+                    _pending = request;
+                } else {
+                    finishPing();
+                }
+                return;
+            }
+
+            TelemetrySource* source = getSource(request);
+            _http.rewind(source);
+            if (!_http.nextBatch(source, getLimit(request))) {
+                finishPush(request, true);
+            } else if (_http.startBatch(source)) {
+                _pending = request;
+            } else {
+                finishPush(request, false);
+            }
+        }
+
+        // Handle the response of the request started by startPending(). A push continues with the
+        // next batch, if there is more data.
+        void finishPending() {
+            uint8_t request = _pending;
+            _pending = INFLUXDB_REQUEST_NONE;
+            if (request == INFLUXDB_REQUEST_PING) {
+                if (finishPing()) {
+                    releaseNetwork();
+                }
+                return;
+            }
+
+            TelemetrySource* source = getSource(request);
+            bool success = _http.finishBatch(source);
+            if (success) {
+                syncTime(_http.getDate());
+            }
+            if (success && _http.nextBatch(source, getLimit(request))) {
+                if (_http.startBatch(source)) {
+                    _pending = request;
+                    return;
+                }
+                success = false;
+            }
+            finishPush(request, success);
+        }
+
+        // Same as at the end of push() and pushSpool(), for the pushes moved forward by loop().
+        void finishPush(uint8_t request, bool success) {
+            if (request == INFLUXDB_REQUEST_SPOOL) {
+                pushSpoolDone(success);
+            } else if (pushDone(success)) {
+                pushed();
             }
-            http->end();
+        }
+
+        TelemetrySource* getSource(uint8_t request) {
+            return request == INFLUXDB_REQUEST_SPOOL ? (TelemetrySource*)_spool : (TelemetrySource*)&telemetry;
+        }
+
+        size_t getLimit(uint8_t request) {
+            return request == INFLUXDB_REQUEST_SPOOL ? TELEMETRY_SPOOL_UPLOAD_SIZE : SIZE_MAX;
         }
 
         bool push() {
             beforePush();
+            return pushDone(send(&telemetry, SIZE_MAX));
+        }
 
-            String url = "";
-            url += _settings->address;
-            url += "/write?precision=s&db=";
-            url += _settings->database;
-
-            http->begin(this->_wifiClient, url);
-            int statusCode = http->POST((uint8_t *)telemetryData, telemetryDataSize-1);  // -1 to remove
-                        
-            bool success = statusCode == 204;                                                                // the last '\n'.
+        bool pushDone(bool success) {
             if (success) {
-                telemetryDataSize = 0;
-                syncTime(http->header("date").c_str());
+                _retry.success();
                 afterPush();
             } else {
-                _logger->log("Push failed with HTTP %d", statusCode);
-                if (_wifi != NULL) {
-                    _wifi->disconnect();
-                    _wifi->connect();
+                if (telemetry.size() >= 0.80f * telemetry.capacity()) {
+                    // Free the buffer, the push may keep failing for a long time.
+                    spill();
                 }
+                failed();
             }
+            return success;
+        }
+
+        // The whole buffer was pushed.
+        void pushed() {
+            lastDataPush = millis();
+            schedulePush();
+            releaseNetwork();
+        }
+
+        // Delay the next attempt and release the WiFi for the time of the backoff.
+        void failed() {
+            _retry.failure();
+            _connection->failed();
+            // Not due before the backoff ends, so the WiFi can be turned off meanwhile.
+            if (_wifi != NULL) {
+                _wifi->schedule(_wifiModule, millis() + _retry.getRetryIn(), 0);
+            }
+            releaseNetwork();
+        }
+
+        // Get a WiFi lease. Returns true once connected.
+        bool acquireNetwork() {
+            return _wifi == NULL || _wifi->acquire(_wifiModule);
+        }
 
-            http->end();
+        // Release the WiFi lease. The WiFi is kept on in the first 30 minutes, so the web UI stays
+        // available.
+        void releaseNetwork() {
+            if (_wifi == NULL) {
+                return;
+            }
+            bool disconnect = millis() > 30 * 60 * 1000;
+            if (disconnect) {
+                _connection->stop();
+            }
+            _wifi->release(_wifiModule, disconnect);
+        }
+
+        // The next push is due after the push interval. It can be done up to a quarter of the
+        // interval earlier, if the WiFi is on for another module anyway.
+        void schedulePush() {
+            if (_wifi != NULL) {
+                unsigned long interval = _settings->pushInterval * 1000UL;
+                _wifi->schedule(_wifiModule, lastDataPush + interval, interval / 4);
+            }
+        }
+
+        bool isPushDue() {
+            if (_wifi != NULL && _wifiModule != WIFI_NO_MODULE) {
+                return _wifi->isDue(_wifiModule);
+            }
+            return millis() - lastDataPush > _settings->pushInterval * 1000;
+        }
+
+        // Push up to TELEMETRY_SPOOL_UPLOAD_SIZE bytes from the spool.
+        bool pushSpool() {
+            return pushSpoolDone(send(_spool, TELEMETRY_SPOOL_UPLOAD_SIZE));
+        }
+
+        bool pushSpoolDone(bool success) {
+            if (success) {
+                _retry.success();
+            } else {
+                failed();
+            }
             return success;
         }
 
-        char telemetryData[TELEMETRY_BUFFER_SIZE];
-        unsigned int telemetryDataSize = 0;
+        void appendPoint(const char* measurement, const char* tags, TelemetryField* fields, uint8_t count) {
+            uint32_t timestamp = _clock.isSet() ? getTimestamp() : 0;
+            bool appended = telemetry.appendPoint(measurement, tags, fields, count, timestamp) ||
+                (spill() && telemetry.appendPoint(measurement, tags, fields, count, timestamp));
+            if (!appended) {
+                _logger->warn(LOG_MODULE_INFLUXDB, "Telemetry buffer overflow!");
+            }
+        }
+
+        // A wake-up in deep sleep mode. The values are collected in the RTC sample log and the
+        // device goes back to sleep. The radio is turned on only when the log is full, the push is
+        // due or the clock needs syncing.
+        void deepSleepLoop() {
+            if (!_rtcLogLoaded) {
+                _rtcLogLoaded = true;
+                _rtcLog.load();
+                if (!_clock.isSet() && _rtcLog.data.time > 0) {
+                    _clock.sync(_rtcLog.data.time, _rtcLog.data.timeError);
+                }
+                _wakeStartSamples = _rtcLog.size();
+            }
+
+            // Collect once per wake-up, unless already done before a reboot for enabling the radio.
+            if (!_wakeCollected && _clock.isSet()) {
+                _wakeCollected = true;
+                if (!(_rtcLog.data.flags & RTC_SAMPLE_LOG_COLLECTED) && shouldCollect()) {
+                    collectData();
+                }
+                _rtcLog.data.flags &= ~RTC_SAMPLE_LOG_COLLECTED;
+            }
+
+            uint32_t now = _clock.isSet() ? getTimestamp() : 0;
+            bool networkNeeded = !_clock.isSet() ||
+                _clock.getError() > DEEP_SLEEP_MAX_TIME_ERROR ||
+                _rtcLog.isFull() ||
+                !telemetry.isEmpty() ||
+                now - _rtcLog.data.lastPush >= _settings->pushInterval ||
+                shouldPush();
+            if (!networkNeeded || now < _rtcLog.data.nextAttempt) {
+                deepSleep(_settings->collectInterval * 1000UL);
+                return;
+            }
+
+            if (_rtcLog.data.flags & RTC_SAMPLE_LOG_RF_DISABLED) {
+                // Woke up with the radio disabled. Reboot with it enabled.
+                _rtcLog.data.flags = _wakeCollected ? RTC_SAMPLE_LOG_COLLECTED : 0;
+                _rtcLog.save();
+                ESP.deepSleep(1, WAKE_RF_DEFAULT);
+                return;
+            }
+
+            if (millis() > DEEP_SLEEP_MAX_AWAKE || (_wifi != NULL && _wifi->isInAPMode())) {
+                _logger->warn(LOG_MODULE_INFLUXDB, "Network is not available");
+                deepSleepFailed(now);
+                return;
+            }
+
+            if (!acquireNetwork() || _connection->isBusy(&_request)) {
+                // Waiting for the connection, or for the request of another component.
+                return;
+            }
+
+            if (!_clock.isSet() || _clock.getError() > DEEP_SLEEP_MAX_TIME_ERROR) {
+                // Collected on the next loop() call, once the clock is set.
+                if (!sync()) {
+                    deepSleepFailed(now);
+                }
+                return;
+            }
+
+            for (uint8_t i = 0; i < _rtcLog.size(); i++) {
+                TelemetryRecord* sample = _rtcLog.getSample(i);
+                if (!telemetry.append(_rtcLog.getMetric(i), sample->value, sample->precision, _rtcLog.getTimestamp(i))) {
+                    _logger->warn(LOG_MODULE_INFLUXDB, "Telemetry buffer overflow!");
+                    break;
+                }
+            }
+
+            if (push()) {
+                _rtcLog.clear();
+                _rtcLog.data.lastPush = now;
+                _rtcLog.data.failures = 0;
+                _rtcLog.data.nextAttempt = 0;
+                deepSleep(_settings->collectInterval * 1000UL);
+            } else {
+                // The samples are still in the RTC log.
+                telemetry.clear();
+                deepSleepFailed(now);
+            }
+        }
+
+        // Delay the next network use with exponential backoff. Without time the backoff is done by
+        // sleeping, as there are no samples to collect meanwhile.
+        void deepSleepFailed(uint32_t now) {
+            if (_rtcLog.data.failures < 16) {
+                _rtcLog.data.failures++;
+            }
+            uint32_t backoff = min((uint32_t)_settings->collectInterval << _rtcLog.data.failures,
+                                   (uint32_t)(DEEP_SLEEP_MAX_BACKOFF));
+
+            if (_clock.isSet()) {
+                _rtcLog.data.nextAttempt = now + backoff;
+                deepSleep(_settings->collectInterval * 1000UL);
+            } else {
+                deepSleep(backoff * 1000);
+            }
+        }
+
+        // Save the state in the RTC memory and sleep until the next collect, counting the time
+        // awake. The radio is enabled for the next wake-up only if it is expected to need it.
+        void deepSleep(uint32_t interval) {
+            uint32_t duration = interval > millis() + 1000 ? interval - millis() : 1000;
+
+            bool networkNext = !_clock.isSet();
+            if (_clock.isSet()) {
+                uint32_t timeError = _clock.getError() + duration / 100 * DEEP_SLEEP_TIME_ERROR;
+                _rtcLog.data.time = _clock.nowMillis() + duration;
+                _rtcLog.data.timeError = timeError;
+
+                uint32_t next = _rtcLog.data.time / 1000;
+                uint8_t wakeSamples = _rtcLog.size() > _wakeStartSamples ? _rtcLog.size() - _wakeStartSamples : 1;
+                networkNext = next >= _rtcLog.data.nextAttempt &&
+                    (timeError > DEEP_SLEEP_MAX_TIME_ERROR ||
+                     _rtcLog.size() + wakeSamples > RTC_SAMPLE_LOG_MAX_SAMPLES ||
+                     next - _rtcLog.data.lastPush >= _settings->pushInterval);
+            }
+            _rtcLog.data.flags = networkNext ? 0 : RTC_SAMPLE_LOG_RF_DISABLED;
+            _rtcLog.save();
+
+            _connection->stop();
+            if (_wifi != NULL) {
+                _wifi->disconnect();
+            }
+            _logger->debug(LOG_MODULE_INFLUXDB, "Sleeping for %lu ms with %d samples", (unsigned long)duration, _rtcLog.size());
+            ESP.deepSleep((uint64_t)duration * 1000, networkNext ? WAKE_RF_DEFAULT : WAKE_RF_DISABLED);
+        }
+
+        // Move the buffer data to the spool. Not while a batched push is in flight - its body is
+        // still being sent from the push buffer and the buffer cursor is in use, the new sample is
+        // dropped instead.
+        bool spill() {
+            if (_spool == NULL || telemetry.isEmpty() || _pending != INFLUXDB_REQUEST_NONE) {
+                return false;
+            }
+
+            uint16_t used = telemetry.size();
+            if (!_spool->spill(&telemetry, pushBuffer, sizeof(pushBuffer))) {
+                return false;
+            }
+            _logger->info(LOG_MODULE_INFLUXDB, "Spooled %d%% of the telemetry buffer to flash", (int)(100L * used / telemetry.capacity()));
+            return true;
+        }
+
+        // Push up to limit bytes of line protocol from the source, using the configured push mode.
+        bool send(TelemetrySource* source, size_t limit) {
+            TelemetryTransport* transport = getTransport();
+            if (transport == NULL || !transport->send(source, limit)) {
+                return false;
+            }
+            if (transport->getDate()[0] != '\0') {
+                syncTime(transport->getDate());
+            }
+            return true;
+        }
+
+        // The custom transport or the one for the push mode. NULL if it can't be used now.
+        TelemetryTransport* getTransport() {
+            if (_transport != NULL) {
+                return _transport;
+            }
+            if (_settings->pushMode == PUSH_MODE_UDP) {
+                // Same host as the HTTP address, so it is resolved once for both.
+                if (!_connection->resolve(_settings->address)) {
+                    return NULL;
+                }
+                _udp.setTarget(_connection->getIP(), _settings->udpPort > 0 ? _settings->udpPort : INFLUXDB_UDP_PORT);
+                return &_udp;
+            }
+            _http.setChunked(_settings->pushMode == PUSH_MODE_CHUNKED || _settings->pushMode == PUSH_MODE_CHUNKED_GZIP,
+                             _settings->pushMode == PUSH_MODE_CHUNKED_GZIP);
+            return &_http;
+        }
+
+        // The write uri depends only on the settings, so it is built once they change.
+        void updateTarget() {
+            _http.setTarget(_settings->address, _settings->database);
+        }
+
+        TelemetryStore telemetry;
+        const char* pointMeasurement = NULL;
+        const char* pointTags = NULL;
+        TelemetryField pointFields[TELEMETRY_MAX_POINT_FIELDS];
+        uint8_t pointFieldsCount = 0;
+        char pushBuffer[TELEMETRY_PUSH_BUFFER_SIZE];
         unsigned long lastDataCollect;
         unsigned long lastDataPush;
-        unsigned long remoteTimestamp;
-        unsigned long remoteTimestampMillis;
+        TelemetryAggregator _aggregator;
+        unsigned long windowStart;
+        RTCSampleLog _rtcLog;
+        bool _rtcLogLoaded = false;
+        bool _wakeCollected = false;
+        uint8_t _wakeStartSamples = 0;
+        TelemetryDeadband _deadband;
+        DriftClock _clock;
         bool enabled = false;
-        HTTPClient* http = NULL;
 
         Logger* _logger = NULL;
         WiFiManager* _wifi = NULL;
+        uint8_t _wifiModule = WIFI_NO_MODULE;
         InfluxDBCollectorSettings* _settings = NULL;
         NetworkSettings* _networkSettings = NULL;
-        WiFiClient _wifiClient = WiFiClient();
+        TelemetrySpool* _spool = NULL;
+        RetryPolicy _retry;
+        HttpConnection* _connection = NULL;
+        AsyncHttpRequest _request;
+        uint8_t _pending = INFLUXDB_REQUEST_NONE;
+        HttpTransport _http;
+        UdpTransport _udp;
+        TelemetryTransport* _transport = NULL;
 };
@@ -1,32 +1,176 @@
 #pragma once
 
 #include "Arduino.h"
+#include "RTCLogTail.h"
 
 #ifndef LOG_SIZE
 #define LOG_SIZE 1024
 #endif
 
+// Maximum size of the arguments of a single binary log record. The strings are copied, the ones
+// that don't fit are truncated. 128 keeps a message logged with log(char*) as long as in the text
+// mode, where a line is up to 127 characters.
+#ifndef LOG_MAX_ARGS_SIZE
+#define LOG_MAX_ARGS_SIZE 128
+#endif
+
+// Whether the lines are printed to the Serial by default. In the binary mode that would format
+// each message when it is logged, so it is off by default.
+#ifndef LOG_SERIAL_OUTPUT
+#ifdef LOG_BINARY
+#define LOG_SERIAL_OUTPUT false
+#else
+#define LOG_SERIAL_OUTPUT true
+#endif
+#endif
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE 4
+
+// The debug(), info(), warn() and error() calls below that level are compiled out.
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// The runtime level of the modules after start, can be changed with setLevel().
+#ifndef LOG_DEFAULT_LEVEL
+#define LOG_DEFAULT_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_MODULE_WIFI 0
+#define LOG_MODULE_INFLUXDB 1
+#define LOG_MODULE_RS485 2
+#define LOG_MODULE_SETTINGS 3
+#define LOG_MODULE_SYSTEM 4
+#define LOG_MODULE_COUNT 5
+// The messages logged with log(), without a module and a level.
+#define LOG_MODULE_NONE 0xFF
+
+#ifdef LOG_BINARY
+#define LOG_ARG_NONE 0
+#define LOG_ARG_INT 1
+#define LOG_ARG_LONG 2
+#define LOG_ARG_LONG_LONG 3
+#define LOG_ARG_SIZE 4
+#define LOG_ARG_DOUBLE 5
+#define LOG_ARG_STRING 6
+#define LOG_ARG_POINTER 7
+
+// A formatted record - a line up to 127 characters, like in the text mode, after the time prefix.
+#define LOG_RECORD_LINE_SIZE (128 + 16)
+
+// Header of a binary log record, followed by the raw arguments.
+struct LogRecord {
+    const char* format;     // NULL marks the end of the data before the ring wraps.
+    uint32_t time;          // millis() of the log() call.
+    uint16_t size;          // Size of the arguments.
+    uint8_t level;
+    uint8_t module;
+};
+#endif
+
 /*
  * Logging tool.
- * 
- * Provide rotating log buffer with configurable maximum size.
+ *
+ * Provide rotating log buffer with configurable maximum size. The buffer is a ring of lines - a new
+ * line drops as many of the oldest ones as needed, without moving the rest.
+ *
+ * With LOG_BINARY defined, log() doesn't format the message. It stores the time, the pointer to
+ * the format string and the raw arguments in a ring of records, and the formatting is done only
+ * when the logs are read. The format has to be a string literal then, as only the pointer is
+ * kept. The '*' width and precision are not supported. With the serial output on, the message is
+ * still formatted for the Serial, so it is off by default in that mode.
+ *
+ * The modules log with debug(), info(), warn() and error(), with the module as the first argument.
+ * The lines are tagged like "W [wifi] ...". The calls below LOG_LEVEL are compiled out, together
+ * with their format strings and arguments, as long as evaluating the arguments has no side
+ * effects. The rest are filtered by the runtime level of the module.
+ *
+ * The warnings and the errors are also kept in a small RTCLogTail, unless RTC_LOG_TAIL_SIZE is 0.
+ * After a reset, begin() restores them to the log, together with the reset reason.
  */
 class Logger {
     public:
-        Logger(bool serial_output=true) {
+        Logger(bool serial_output=LOG_SERIAL_OUTPUT) {
             this->serial_output = serial_output;
+            for (uint8_t i = 0; i < LOG_MODULE_COUNT; i++) {
+                levels[i] = LOG_DEFAULT_LEVEL;
+            }
         }
 
         void begin() {
+#ifndef LOG_BINARY
             buffer[0] = '\0';
+#endif
+#if RTC_LOG_TAIL_SIZE > 0
+            if (rtcTail.load()) {
+                rtcTail.forEachLine([this](const char* line) {
+                    log("Before reset: %s", line);
+                });
+                rtcTail.clear();
+            }
+#endif
+            log("Reset reason: %s", ESP.getResetReason().c_str());
         }
 
         void loop() {
         }
 
+        template<typename... Args>
+        void debug(uint8_t module, const char* format, Args... args) {
+            logAt<LOG_LEVEL_DEBUG>(module, format, args...);
+        }
+
+        template<typename... Args>
+        void info(uint8_t module, const char* format, Args... args) {
+            logAt<LOG_LEVEL_INFO>(module, format, args...);
+        }
+
+        template<typename... Args>
+        void warn(uint8_t module, const char* format, Args... args) {
+            logAt<LOG_LEVEL_WARN>(module, format, args...);
+        }
+
+        template<typename... Args>
+        void error(uint8_t module, const char* format, Args... args) {
+            logAt<LOG_LEVEL_ERROR>(module, format, args...);
+        }
+
+        // The messages of the module below the level are dropped. The ones below LOG_LEVEL are
+        // not compiled in, so they can't be enabled here.
+        void setLevel(uint8_t module, uint8_t level) {
+            if (module < LOG_MODULE_COUNT && level <= LOG_LEVEL_NONE) {
+                levels[module] = level;
+            }
+        }
+
+        uint8_t getLevel(uint8_t module) {
+            return module < LOG_MODULE_COUNT ? levels[module] : LOG_LEVEL_NONE;
+        }
+
+        static const char* getModuleName(uint8_t module) {
+            static const char* const names[] = {"wifi", "influxdb", "rs485", "settings", "system"};
+            return module < LOG_MODULE_COUNT ? names[module] : "";
+        }
+
+        // The number of lines logged since start, the position after the newest line for readLines().
+        uint32_t getLineCount() {
+            return linesLogged;
+        }
+
+        static const char* getLevelName(uint8_t level) {
+            static const char* const names[] = {"debug", "info", "warn", "error", "none"};
+            return level <= LOG_LEVEL_NONE ? names[level] : "";
+        }
+
+#ifndef LOG_BINARY
         void log(char* msg) {
+            size_t length = min(strlen(msg), (size_t)LOG_SIZE - 1);
             // Check if the log is being duplicated. There is no usecase for identical logs...
-            if (pos > strlen(msg) && strncmp(msg, buffer + pos - strlen(msg) - 1, strlen(msg)) == 0) {
+            if (used > 0 && length == lastLength && isLast(msg, length)) {
                 return;
             }
 
@@ -34,42 +178,544 @@ class Logger {
                 Serial.println(msg);
             }
 
-            // new_size = pos + strlen(msg) + 1 '\n' + 1 '\0'
-            // this will overflow the buffer by new_size - sizeof(buffer)
-            int overflowBy = pos + strlen(msg) + 2 - sizeof(buffer);
+            // Drop the oldest lines until the new one fits, with its '\n'.
+            while (used + length + 1 > LOG_SIZE) {
+                dropLine();
+            }
+            write(msg, length);
+            write("\n", 1);
+            lastLength = length;
+            lines++;
+            linesLogged++;
+        }
+
+        void log(const char *format, ...) {
+            va_list arg;
+            va_start(arg, format);
+            logv(LOG_LEVEL_INFO, LOG_MODULE_NONE, format, arg);
+            va_end(arg);
+        }
 
-            if (overflowBy > 0) {
-                // shift back overflowBy chars to avoid buffer overflow
-                memmove(buffer, buffer + overflowBy, sizeof(buffer) - overflowBy);
-                pos -= overflowBy;
+        // The logs as a single string. The ring is rotated to start at the beginning of the buffer,
+        // so prefer streamLogs() where the output can be written in parts.
+        const char* getLogs() {
+            if (head != 0) {
+                reverse(0, head);
+                reverse(head, LOG_SIZE);
+                reverse(0, LOG_SIZE);
+                head = 0;
             }
+            buffer[used] = '\0';
+            return buffer;
+        }
 
-            strcpy(buffer + pos, msg);
-            pos += strlen(msg);
+        // Pass the logs to the callback, oldest first. The ring is passed as its two segments.
+        void streamLogs(std::function<void(const char*, size_t)> callback) {
+            size_t first = min((size_t)used, (size_t)LOG_SIZE - head);
+            if (first > 0) {
+                callback(buffer + head, first);
+            }
+            if (used > first) {
+                callback(buffer, used - first);
+            }
+        }
 
-            // add new line char
-            buffer[pos] = '\n';
-            pos++;
+        // Pass the lines logged from the position on to the callback, oldest first, without the
+        // '\n'. The position counts the lines logged since start and is moved past each line the
+        // callback accepts - it returns false to stop. Returns the number of lines dropped from the
+        // buffer before they were read.
+        uint32_t readLines(uint32_t& position, std::function<bool(const char*, size_t)> callback) {
+            uint32_t oldest = linesLogged - lines;
+            uint32_t dropped = 0;
+            if ((int32_t)(position - oldest) < 0) {
+                dropped = oldest - position;
+                position = oldest;
+            }
 
-            // add null terminating character
-            buffer[pos] = 0;
+            size_t offset = 0;
+            for (uint32_t i = oldest; i != position; i++) {
+                while (buffer[(head + offset++) % LOG_SIZE] != '\n') {
+                }
+            }
+            char line[128];
+            while (position != linesLogged) {
+                size_t length = 0;
+                char c;
+                while ((c = buffer[(head + offset++) % LOG_SIZE]) != '\n') {
+                    if (length < sizeof(line) - 1) {
+                        line[length++] = c;
+                    }
+                }
+                line[length] = '\0';
+                if (!callback(line, length)) {
+                    break;
+                }
+                position++;
+            }
+            return dropped;
+        }
+#else
+        // A message that is not a literal, stored as a copy.
+        void log(char* msg) {
+            log("%s", msg);
         }
 
         void log(const char *format, ...) {
             va_list arg;
             va_start(arg, format);
-            char buffer[128];
-            vsnprintf(buffer, sizeof(buffer), format, arg);
+            logv(LOG_LEVEL_INFO, LOG_MODULE_NONE, format, arg);
             va_end(arg);
-            log(buffer);
         }
 
+        // Format the records and pass them to the callback, a line at a time, oldest first.
+        void streamLogs(std::function<void(const char*, size_t)> callback) {
+            char line[LOG_RECORD_LINE_SIZE];
+            uint16_t offset = head;
+            for (uint16_t i = 0; i < count; i++) {
+                formatRecord(getRecord(offset), line, sizeof(line) - 1);
+                size_t length = strlen(line);
+                line[length++] = '\n';
+                callback(line, length);
+                offset = next(offset);
+            }
+        }
+
+        // Same as in the text mode, the lines are formatted on the way.
+        uint32_t readLines(uint32_t& position, std::function<bool(const char*, size_t)> callback) {
+            uint32_t oldest = linesLogged - count;
+            uint32_t dropped = 0;
+            if ((int32_t)(position - oldest) < 0) {
+                dropped = oldest - position;
+                position = oldest;
+            }
+
+            uint16_t offset = head;
+            for (uint32_t i = oldest; i != position; i++) {
+                offset = next(offset);
+            }
+            char line[LOG_RECORD_LINE_SIZE];
+            while (position != linesLogged) {
+                formatRecord(getRecord(offset), line, sizeof(line));
+                if (!callback(line, strlen(line))) {
+                    break;
+                }
+                offset = next(offset);
+                position++;
+            }
+            return dropped;
+        }
+
+        // Format the records. The text is kept until the next call.
         const char* getLogs() {
-            return buffer;
+            text = "";
+            if (count == 0) {
+                return text.c_str();
+            }
+
+            char line[LOG_RECORD_LINE_SIZE];
+            uint16_t offset = head;
+            for (uint16_t i = 0; i < count; i++) {
+                LogRecord* record = getRecord(offset);
+                formatRecord(record, line, sizeof(line));
+                text += line;
+                text += "\n";
+                offset = next(offset);
+            }
+            return text.c_str();
         }
+#endif
 
     private:
-        char buffer[LOG_SIZE];
-        unsigned int pos = 0;
+        template<uint8_t level, typename... Args>
+        void logAt(uint8_t module, const char* format, Args... args) {
+            // The levels below LOG_LEVEL are discarded at compile time, without the call.
+            if constexpr (level >= LOG_LEVEL) {
+                if (level >= levels[module]) {
+                    logTagged(level, module, format, args...);
+                }
+            }
+        }
+
+        void logTagged(uint8_t level, uint8_t module, const char* format, ...) {
+            va_list arg;
+            va_start(arg, format);
+            logv(level, module, format, arg);
+            va_end(arg);
+        }
+
+        // Like "W [wifi] ", nothing for the messages without a module.
+        static int formatTag(char* buffer, size_t size, uint8_t level, uint8_t module) {
+            if (module == LOG_MODULE_NONE) {
+                buffer[0] = '\0';
+                return 0;
+            }
+            return snprintf(buffer, size, "%c [%s] ", toupper(getLevelName(level)[0]), getModuleName(module));
+        }
+
+        // Keep the warnings and the errors in the RTC memory, with the uptime in seconds.
+        void appendTail(uint8_t level, uint8_t module, const char* format, va_list arg) {
+#if RTC_LOG_TAIL_SIZE > 0
+            if (level < LOG_LEVEL_WARN || module == LOG_MODULE_NONE) {
+                return;
+            }
+            va_list copy;
+            va_copy(copy, arg);
+            char line[RTC_LOG_TAIL_SIZE];
+            int length = snprintf(line, sizeof(line), "%lu ", (unsigned long)(millis() / 1000));
+            length += formatTag(line + length, sizeof(line) - length, level, module);
+            vsnprintf(line + length, sizeof(line) - length, format, copy);
+            va_end(copy);
+            rtcTail.append(line);
+#endif
+        }
+
+#ifdef LOG_BINARY
+        void logv(uint8_t level, uint8_t module, const char* format, va_list arg) {
+            appendTail(level, module, format, arg);
+            if (this->serial_output) {
+                va_list copy;
+                va_copy(copy, arg);
+                char line[128];
+                int length = formatTag(line, sizeof(line), level, module);
+                vsnprintf(line + length, sizeof(line) - length, format, copy);
+                va_end(copy);
+                Serial.println(line);
+            }
+
+            uint8_t args[LOG_MAX_ARGS_SIZE];
+            size_t size = captureArgs(format, arg, args, sizeof(args));
+            append(format, args, size, level, module);
+        }
+
+        // Find the next conversion in the format, starting from the '%'. Returns the position of
+        // the conversion character, or NULL if there is none. The argument type is set in kind,
+        // LOG_ARG_NONE for "%%".
+        static const char* nextConversion(const char* format, uint8_t& kind) {
+            const char* p = strchr(format, '%');
+            if (p == NULL) {
+                return NULL;
+            }
+            p++;
+            while (*p != '\0' && strchr("-+ #0", *p) != NULL) {
+                p++;
+            }
+            while (isdigit(*p) || *p == '.') {
+                p++;
+            }
+
+            uint8_t longs = 0;
+            bool sizeModifier = false;
+            while (*p != '\0' && strchr("lhzjt", *p) != NULL) {
+                longs += *p == 'l';
+                sizeModifier |= *p == 'z';
+                p++;
+            }
+
+            switch (*p) {
+                case '\0':
+                    return NULL;
+                case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+                    kind = longs >= 2 ? LOG_ARG_LONG_LONG :
+                        longs == 1 ? LOG_ARG_LONG :
+                        sizeModifier ? LOG_ARG_SIZE : LOG_ARG_INT;
+                    break;
+                case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                    kind = LOG_ARG_DOUBLE;
+                    break;
+                case 's':
+                    kind = LOG_ARG_STRING;
+                    break;
+                case 'p':
+                    kind = LOG_ARG_POINTER;
+                    break;
+                default:
+                    kind = LOG_ARG_NONE;
+            }
+            return p;
+        }
+
+        // Copy the arguments described by the format. The strings are copied with the '\0' and
+        // truncated if there is no space left. The arguments that don't fit are dropped.
+        static size_t captureArgs(const char* format, va_list arg, uint8_t* args, size_t size) {
+            size_t pos = 0;
+            uint8_t kind;
+            const char* p = format;
+            while ((p = nextConversion(p, kind)) != NULL) {
+                p++;
+                switch (kind) {
+                    case LOG_ARG_INT: {
+                        int value = va_arg(arg, int);
+                        if (!put(args, size, pos, &value, sizeof(value))) {
+                            return pos;
+                        }
+                        break;
+                    }
+                    case LOG_ARG_LONG: {
+                        long value = va_arg(arg, long);
+                        if (!put(args, size, pos, &value, sizeof(value))) {
+                            return pos;
+                        }
+                        break;
+                    }
+                    case LOG_ARG_LONG_LONG: {
+                        long long value = va_arg(arg, long long);
+                        if (!put(args, size, pos, &value, sizeof(value))) {
+                            return pos;
+                        }
+                        break;
+                    }
+                    case LOG_ARG_SIZE: {
+                        size_t value = va_arg(arg, size_t);
+                        if (!put(args, size, pos, &value, sizeof(value))) {
+                            return pos;
+                        }
+                        break;
+                    }
+                    case LOG_ARG_DOUBLE: {
+                        double value = va_arg(arg, double);
+                        if (!put(args, size, pos, &value, sizeof(value))) {
+                            return pos;
+                        }
+                        break;
+                    }
+                    case LOG_ARG_POINTER: {
+                        void* value = va_arg(arg, void*);
+                        if (!put(args, size, pos, &value, sizeof(value))) {
+                            return pos;
+                        }
+                        break;
+                    }
+                    case LOG_ARG_STRING: {
+                        const char* value = va_arg(arg, const char*);
+                        if (value == NULL) {
+                            value = "(null)";
+                        }
+                        if (pos >= size) {
+                            return pos;
+                        }
+                        size_t length = strnlen(value, size - pos - 1);
+                        memcpy(args + pos, value, length);
+                        args[pos + length] = '\0';
+                        pos += length + 1;
+                        break;
+                    }
+                }
+            }
+            return pos;
+        }
+
+        static bool put(uint8_t* args, size_t size, size_t& pos, const void* value, size_t length) {
+            if (pos + length > size) {
+                return false;
+            }
+            memcpy(args + pos, value, length);
+            pos += length;
+            return true;
+        }
+
+        // Render the record as text, the same way vsnprintf would.
+        void formatRecord(LogRecord* record, char* line, size_t size) {
+            const uint8_t* args = (const uint8_t*)(record + 1);
+            const uint8_t* argsEnd = args + record->size;
+            int pos = snprintf(line, size, "%lu.%03lu ",
+                               (unsigned long)(record->time / 1000),
+                               (unsigned long)(record->time % 1000));
+            if ((size_t)pos < size) {
+                pos += formatTag(line + pos, size - pos, record->level, record->module);
+            }
+
+            uint8_t kind;
+            const char* text = record->format;
+            const char* conversion;
+            while ((size_t)pos < size && (conversion = nextConversion(text, kind)) != NULL) {
+                const char* spec = strchr(text, '%');
+                pos += snprintf(line + pos, size - pos, "%.*s", (int)(spec - text), text);
+                text = conversion + 1;
+                if ((size_t)pos >= size) {
+                    break;
+                }
+
+                char fmt[16];
+                size_t specLength = min((size_t)(text - spec), sizeof(fmt) - 1);
+                memcpy(fmt, spec, specLength);
+                fmt[specLength] = '\0';
+                pos += formatArg(line + pos, size - pos, fmt, kind, args, argsEnd);
+            }
+            if ((size_t)pos < size) {
+                snprintf(line + pos, size - pos, "%s", text);
+            }
+        }
+
+        static int formatArg(char* out, size_t size, const char* fmt, uint8_t kind,
+                             const uint8_t*& args, const uint8_t* argsEnd) {
+            switch (kind) {
+                case LOG_ARG_NONE:
+                    // "%%" or an unsupported conversion, printed as is.
+                    return snprintf(out, size, "%s", strcmp(fmt, "%%") == 0 ? "%" : fmt);
+                case LOG_ARG_INT:
+                    return snprintf(out, size, fmt, get<int>(args, argsEnd));
+                case LOG_ARG_LONG:
+                    return snprintf(out, size, fmt, get<long>(args, argsEnd));
+                case LOG_ARG_LONG_LONG:
+                    return snprintf(out, size, fmt, get<long long>(args, argsEnd));
+                case LOG_ARG_SIZE:
+                    return snprintf(out, size, fmt, get<size_t>(args, argsEnd));
+                case LOG_ARG_DOUBLE:
+                    return snprintf(out, size, fmt, get<double>(args, argsEnd));
+                case LOG_ARG_POINTER:
+                    return snprintf(out, size, fmt, get<void*>(args, argsEnd));
+                case LOG_ARG_STRING: {
+                    const char* value = "";
+                    if (args < argsEnd) {
+                        value = (const char*)args;
+                        args += strnlen(value, argsEnd - args) + 1;
+                    }
+                    return snprintf(out, size, fmt, value);
+                }
+            }
+            return 0;
+        }
+
+        // Read an argument. The missing ones, truncated on capture, read as 0.
+        template<class T>
+        static T get(const uint8_t*& args, const uint8_t* argsEnd) {
+            T value = 0;
+            if (args + sizeof(T) <= argsEnd) {
+                memcpy(&value, args, sizeof(T));
+                args += sizeof(T);
+            }
+            return value;
+        }
+
+        // Append a record, dropping the oldest ones to make space. Each record is contiguous. If
+        // it doesn't fit before the end of the ring, it goes to the start.
+        void append(const char* format, const uint8_t* args, size_t size, uint8_t level, uint8_t module) {
+            // There is no usecase for identical logs...
+            if (count > 0) {
+                LogRecord* record = getRecord(last);
+                if (record->format == format && record->module == module && record->size == size &&
+                    memcmp(record + 1, args, size) == 0) {
+                    return;
+                }
+            }
+
+            uint16_t length = (sizeof(LogRecord) + size + 3) & ~3;
+            if (tail + length > LOG_SIZE) {
+                // Drop the records between the tail and the end, and mark the wrap.
+                while (count > 0 && head >= tail) {
+                    evict();
+                }
+                if (tail + sizeof(LogRecord) <= LOG_SIZE) {
+                    getRecord(tail)->format = NULL;
+                }
+                tail = 0;
+            }
+            while (count > 0 && head >= tail && head < tail + length) {
+                evict();
+            }
+            if (count == 0) {
+                head = tail;
+            }
+
+            LogRecord* record = getRecord(tail);
+            record->format = format;
+            record->time = millis();
+            record->size = size;
+            record->level = level;
+            record->module = module;
+            memcpy(record + 1, args, size);
+            last = tail;
+            tail += length;
+            count++;
+            linesLogged++;
+        }
+
+        void evict() {
+            head = next(head);
+            count--;
+        }
+
+        // Offset of the record after the one at the offset.
+        uint16_t next(uint16_t offset) {
+            offset += (sizeof(LogRecord) + getRecord(offset)->size + 3) & ~3;
+            if (offset + sizeof(LogRecord) > LOG_SIZE || getRecord(offset)->format == NULL) {
+                return 0;
+            }
+            return offset;
+        }
+
+        LogRecord* getRecord(uint16_t offset) {
+            return (LogRecord*)((uint8_t*)records + offset);
+        }
+
+        // The ring of records, aligned for the header fields.
+        uint32_t records[LOG_SIZE / 4];
+        uint16_t head = 0;
+        uint16_t tail = 0;
+        uint16_t last = 0;
+        uint16_t count = 0;
+        String text;
+#else
+        void logv(uint8_t level, uint8_t module, const char* format, va_list arg) {
+            appendTail(level, module, format, arg);
+            char buffer[128];
+            int length = formatTag(buffer, sizeof(buffer), level, module);
+            vsnprintf(buffer + length, sizeof(buffer) - length, format, arg);
+            log(buffer);
+        }
+
+        // Copy to the ring, after the newest line.
+        void write(const char* data, size_t length) {
+            size_t tail = (head + used) % LOG_SIZE;
+            size_t first = min(length, (size_t)LOG_SIZE - tail);
+            memcpy(buffer + tail, data, first);
+            memcpy(buffer, data + first, length - first);
+            used += length;
+        }
+
+        // Drop the oldest line. Each byte is scanned once, when its line is dropped.
+        void dropLine() {
+            size_t first = min((size_t)used, (size_t)LOG_SIZE - head);
+            const char* end = (const char*)memchr(buffer + head, '\n', first);
+            size_t length;
+            if (end != NULL) {
+                length = end - (buffer + head) + 1;
+            } else {
+                end = (const char*)memchr(buffer, '\n', used - first);
+                length = end != NULL ? first + (end - buffer) + 1 : used;
+            }
+            head = (head + length) % LOG_SIZE;
+            used -= length;
+            lines--;
+        }
+
+        // Compare the message with the newest line.
+        bool isLast(const char* msg, size_t length) {
+            size_t start = (head + used - 1 - length + LOG_SIZE) % LOG_SIZE;
+            size_t first = min(length, (size_t)LOG_SIZE - start);
+            return memcmp(buffer + start, msg, first) == 0 &&
+                memcmp(buffer, msg + first, length - first) == 0;
+        }
+
+        void reverse(size_t from, size_t to) {
+            while (from + 1 < to) {
+                char c = buffer[from];
+                buffer[from++] = buffer[--to];
+                buffer[to] = c;
+            }
+        }
+
+        // Ring of lines, each ending with '\n'. One more byte for the '\0' of getLogs().
+        char buffer[LOG_SIZE + 1];
+        uint16_t head = 0;
+        uint16_t used = 0;
+        uint16_t lastLength = 0;
+        uint16_t lines = 0;
+#endif
+        uint8_t levels[LOG_MODULE_COUNT];
+        uint32_t linesLogged = 0;
+#if RTC_LOG_TAIL_SIZE > 0
+        RTCLogTail rtcTail;
+#endif
         bool serial_output;
 };
@@ -30,7 +30,7 @@ class RS485ServerBase {
             pinMode(_dePin, OUTPUT);
             digitalWrite(_dePin, LOW);
             _transmitting = false;
-            _logger->log("RS485 initialized");
+            _logger->info(LOG_MODULE_RS485, "RS485 initialized");
 
             registerHandlers();
         }
@@ -51,7 +51,7 @@ class RS485ServerBase {
                 _cmdBuffer[_cmdBufferPos] = nextChar;
                 _cmdBufferPos++;
                 if (_cmdBufferPos >= sizeof(_cmdBuffer)) {
-                    _logger->log("RS485 buffer overflow detected");
+                    _logger->warn(LOG_MODULE_RS485, "RS485 buffer overflow detected");
                     _cmdBuffer[sizeof(_cmdBuffer)-1] = 0;
                     nextChar = 0;
                 }
@@ -69,7 +69,7 @@ class RS485ServerBase {
 
         void registerHandler(const char* cmd, RS485ServerBase::THandlerFunction fn) {
             if (_cmdHandlersPos >= MAX_HANDLERS) {
-                _logger->log("No more handlers can be registerd");
+                _logger->error(LOG_MODULE_RS485, "No more handlers can be registerd");
                 return;
             }
             _cmdHandlers[_cmdHandlersPos] = new CmdHandler(cmd, fn);
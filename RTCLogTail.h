@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Arduino.h"
+
+#define RTC_USER_MEMORY_SIZE 512
+
+// Size of the text kept in the RTC log tail, in bytes. 0 disables the tail.
+#ifndef RTC_LOG_TAIL_SIZE
+#define RTC_LOG_TAIL_SIZE 88
+#endif
+
+// Offset of the tail in the RTC user memory, in 4 bytes blocks. The tail takes the end of the
+// memory, the SettingsBase RTC settings and the RTCSampleLog are placed before it.
+#if RTC_LOG_TAIL_SIZE > 0
+#define RTC_LOG_TAIL_OFFSET ((RTC_USER_MEMORY_SIZE - 4 - ((4 + RTC_LOG_TAIL_SIZE + 3) & ~3)) / 4)
+#else
+#define RTC_LOG_TAIL_OFFSET (RTC_USER_MEMORY_SIZE / 4)
+#endif
+
+#if RTC_LOG_TAIL_SIZE > 0
+struct RTCLogTailData {
+    uint16_t length;                // Bytes of text used.
+    uint16_t reserved;
+    char text[RTC_LOG_TAIL_SIZE];   // Lines ending with '\n', the oldest first.
+};
+
+static_assert(RTC_LOG_TAIL_OFFSET * 4 + 4 + sizeof(RTCLogTailData) <= RTC_USER_MEMORY_SIZE,
+              "The RTC log tail doesn't fit in the RTC user memory");
+
+/*
+ * The last few log lines, kept in the RTC user memory so they survive a reset.
+ *
+ * Same layout as SettingsBase - CRC32 checksum in the first block, followed by the data. The
+ * memory is written on each append, so only the rare lines, like the warnings, should go here.
+ */
+class RTCLogTail {
+    public:
+        // Read the tail from the RTC memory. Returns false and starts an empty tail if the
+        // checksum doesn't match, like after power on.
+        bool load() {
+            uint32_t checksum;
+            ESP.rtcUserMemoryRead(RTC_LOG_TAIL_OFFSET, &checksum, sizeof(checksum));
+            ESP.rtcUserMemoryRead(RTC_LOG_TAIL_OFFSET + 1, (uint32_t*)&data, sizeof(data));
+            if (checksum == crc32(&data, sizeof(data)) && data.length <= sizeof(data.text)) {
+                return true;
+            }
+
+            memset(&data, 0, sizeof(data));
+            return false;
+        }
+
+        // Append the line, dropping the oldest lines to make space, and write the tail.
+        void append(const char* line) {
+            size_t length = min(strlen(line), sizeof(data.text) - 1);
+            size_t drop = 0;
+            while (data.length - drop + length + 1 > sizeof(data.text)) {
+                const char* end = (const char*)memchr(data.text + drop, '\n', data.length - drop);
+                drop = end != NULL ? end - data.text + 1 : data.length;
+            }
+            memmove(data.text, data.text + drop, data.length - drop);
+            data.length -= drop;
+
+            memcpy(data.text + data.length, line, length);
+            data.length += length;
+            data.text[data.length++] = '\n';
+            save();
+        }
+
+        // Pass the lines to the callback, the oldest first, without the '\n'.
+        void forEachLine(std::function<void(const char*)> callback) {
+            char line[RTC_LOG_TAIL_SIZE];
+            size_t start = 0;
+            for (size_t i = 0; i < data.length; i++) {
+                if (data.text[i] == '\n') {
+                    memcpy(line, data.text + start, i - start);
+                    line[i - start] = '\0';
+                    callback(line);
+                    start = i + 1;
+                }
+            }
+        }
+
+        // Drop the lines and write the empty tail, so they are restored only once.
+        void clear() {
+            memset(&data, 0, sizeof(data));
+            save();
+        }
+
+    private:
+        bool save() {
+            uint32_t checksum = crc32(&data, sizeof(data));
+            return ESP.rtcUserMemoryWrite(RTC_LOG_TAIL_OFFSET, &checksum, sizeof(checksum)) &&
+                ESP.rtcUserMemoryWrite(RTC_LOG_TAIL_OFFSET + 1, (uint32_t*)&data, sizeof(data));
+        }
+
+        uint32_t crc32(const void *buffer, uint16_t size) {
+            uint32_t crc = 0xFFFFFFFF;
+            for (uint16_t i = 0; i < size; i++) {
+                crc ^= ((uint8_t*)buffer)[i];
+                for (uint8_t j = 0; j < 8; j++) {
+                    crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+                }
+            }
+            return crc;
+        }
+
+        RTCLogTailData data;
+};
+#endif
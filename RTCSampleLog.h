@@ -0,0 +1,162 @@
+#pragma once
+
+#include "Arduino.h"
+#include "TelemetryBuffer.h"
+#include "RTCLogTail.h"
+
+// Offset of the log in the RTC user memory, in 4 bytes blocks. The SettingsBase RTC settings take
+// the blocks before it - the checksum and the T_RTC struct. The default leaves 60 bytes for them.
+#ifndef RTC_SAMPLE_LOG_OFFSET
+#define RTC_SAMPLE_LOG_OFFSET 16
+#endif
+
+// Maximum number of distinct metric names in the log.
+#ifndef RTC_SAMPLE_LOG_MAX_NAMES
+#define RTC_SAMPLE_LOG_MAX_NAMES 6
+#endif
+
+// Maximum metric name length in the log, including the terminating '\0'.
+#ifndef RTC_SAMPLE_LOG_NAME_SIZE
+#define RTC_SAMPLE_LOG_NAME_SIZE 16
+#endif
+
+// Maximum number of samples in the log. The default fills the space up to the RTC log tail, after
+// the checksum, the 32 bytes of the state and the names. 27 samples with the default tail, 39
+// without it.
+#ifndef RTC_SAMPLE_LOG_MAX_SAMPLES
+#define RTC_SAMPLE_LOG_MAX_SAMPLES \
+    ((int)(RTC_LOG_TAIL_OFFSET * 4 - (RTC_SAMPLE_LOG_OFFSET + 1) * 4 - 32 - \
+           RTC_SAMPLE_LOG_MAX_NAMES * RTC_SAMPLE_LOG_NAME_SIZE) / (int)sizeof(TelemetryRecord))
+#endif
+
+struct RTCSampleLogData {
+    uint64_t time;          // Estimated time at the wake-up, in milliseconds. 0 if unknown.
+    uint32_t timeError;     // Estimated error of the time, in milliseconds.
+    uint32_t lastPush;      // Timestamp of the last successful push.
+    uint32_t nextAttempt;   // Timestamp before which the network should not be used after a failure.
+    uint32_t base;          // Timestamp the sample deltas are relative to.
+    uint8_t failures;       // Consecutive push failures.
+    uint8_t flags;
+    uint8_t count;
+    uint8_t namesCount;
+    char names[RTC_SAMPLE_LOG_MAX_NAMES][RTC_SAMPLE_LOG_NAME_SIZE];
+    TelemetryRecord samples[RTC_SAMPLE_LOG_MAX_SAMPLES];
+};
+
+static_assert((RTC_SAMPLE_LOG_OFFSET + 1) * 4 + sizeof(RTCSampleLogData) <= RTC_LOG_TAIL_OFFSET * 4,
+              "The RTC sample log doesn't fit in the RTC user memory before the log tail");
+
+// The radio was disabled for the current wake-up.
+#define RTC_SAMPLE_LOG_RF_DISABLED 0x01
+// The samples for the current wake-up were collected already, before a reboot for enabling the
+// radio.
+#define RTC_SAMPLE_LOG_COLLECTED 0x02
+
+/*
+ * Sample log kept in the RTC user memory, so it survives the deep sleep.
+ *
+ * Same layout as SettingsBase - CRC32 checksum in the first block, followed by the data. Besides
+ * the samples it keeps the state needed between the wake-ups - the estimated time, the last push
+ * time and the push backoff.
+ */
+class RTCSampleLog {
+    public:
+        // Read the log from the RTC memory. Returns false and starts an empty log if the checksum
+        // doesn't match, like after power on.
+        bool load() {
+            uint32_t checksum;
+            ESP.rtcUserMemoryRead(RTC_SAMPLE_LOG_OFFSET, &checksum, sizeof(checksum));
+            ESP.rtcUserMemoryRead(RTC_SAMPLE_LOG_OFFSET + 1, (uint32_t*)&data, sizeof(data));
+            if (checksum == crc32(&data, sizeof(data))) {
+                return true;
+            }
+
+            memset(&data, 0, sizeof(data));
+            return false;
+        }
+
+        bool save() {
+            uint32_t checksum = crc32(&data, sizeof(data));
+            return ESP.rtcUserMemoryWrite(RTC_SAMPLE_LOG_OFFSET, &checksum, sizeof(checksum)) &&
+                ESP.rtcUserMemoryWrite(RTC_SAMPLE_LOG_OFFSET + 1, (uint32_t*)&data, sizeof(data));
+        }
+
+        bool append(const char* metric, float value, uint8_t precision, uint32_t timestamp) {
+            if (isFull()) {
+                return false;
+            }
+
+            if (data.count == 0) {
+                data.base = timestamp;
+            }
+            if (timestamp < data.base || timestamp - data.base >= TELEMETRY_NO_TIMESTAMP) {
+                return false;
+            }
+
+            int16_t name = intern(metric);
+            if (name < 0) {
+                return false;
+            }
+
+            TelemetryRecord* sample = &data.samples[data.count++];
+            sample->metric = name;
+            sample->precision = precision;
+            sample->delta = timestamp - data.base;
+            sample->value = value;
+            return true;
+        }
+
+        uint8_t size() {
+            return data.count;
+        }
+
+        bool isFull() {
+            return data.count >= RTC_SAMPLE_LOG_MAX_SAMPLES;
+        }
+
+        const char* getMetric(uint8_t index) {
+            return data.names[data.samples[index].metric];
+        }
+
+        TelemetryRecord* getSample(uint8_t index) {
+            return &data.samples[index];
+        }
+
+        uint32_t getTimestamp(uint8_t index) {
+            return data.base + data.samples[index].delta;
+        }
+
+        // Drop the samples. The rest of the state is kept.
+        void clear() {
+            data.count = 0;
+            data.namesCount = 0;
+        }
+
+        RTCSampleLogData data;
+
+    private:
+        int16_t intern(const char* metric) {
+            for (uint8_t i = 0; i < data.namesCount; i++) {
+                if (strcmp(data.names[i], metric) == 0) {
+                    return i;
+                }
+            }
+
+            if (data.namesCount >= RTC_SAMPLE_LOG_MAX_NAMES || strlen(metric) >= RTC_SAMPLE_LOG_NAME_SIZE) {
+                return -1;
+            }
+            strcpy(data.names[data.namesCount], metric);
+            return data.namesCount++;
+        }
+
+        uint32_t crc32(const void *buffer, uint16_t size) {
+            uint32_t crc = 0xFFFFFFFF;
+            for (uint16_t i = 0; i < size; i++) {
+                crc ^= ((uint8_t*)buffer)[i];
+                for (uint8_t j = 0; j < 8; j++) {
+                    crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+                }
+            }
+            return crc;
+        }
+};
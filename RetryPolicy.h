@@ -0,0 +1,149 @@
+#pragma once
+
+#include "Arduino.h"
+
+// Delay after the first failure, in milliseconds.
+#ifndef RETRY_MIN_DELAY
+#define RETRY_MIN_DELAY 10 * 1000
+#endif
+
+// Maximum delay between attempts, in milliseconds.
+#ifndef RETRY_MAX_DELAY
+#define RETRY_MAX_DELAY 30 * 60 * 1000
+#endif
+
+// Consecutive failures that open the circuit.
+#ifndef RETRY_FAILURE_THRESHOLD
+#define RETRY_FAILURE_THRESHOLD 3
+#endif
+
+enum _CircuitState {
+    CIRCUIT_CLOSED,     // Normal operation.
+    CIRCUIT_OPEN,       // Too many failures, waiting for the backoff delay.
+    CIRCUIT_HALF_OPEN   // The delay has passed, a single probe attempt is allowed.
+};
+
+/*
+ * Retry policy for remote calls.
+ *
+ * Each failure delays the next attempt with jittered exponential backoff - the delay doubles on
+ * each consecutive failure and the actual wait is random between half and the full delay, so
+ * devices that failed together don't retry together. After RETRY_FAILURE_THRESHOLD consecutive
+ * failures the circuit opens. Once the delay passes it goes half open - the caller should do a
+ * single cheap probe and report its result. Success closes the circuit and resets the delay.
+ */
+class RetryPolicy {
+    public:
+        RetryPolicy(uint32_t minDelay = RETRY_MIN_DELAY,
+                    uint32_t maxDelay = RETRY_MAX_DELAY,
+                    uint8_t failureThreshold = RETRY_FAILURE_THRESHOLD) {
+            _minDelay = minDelay;
+            _maxDelay = maxDelay;
+            _failureThreshold = failureThreshold;
+        }
+
+        // True if an attempt can be made now.
+        bool canAttempt() {
+            if (!_waiting) {
+                return true;
+            }
+
+            unsigned long waited = millis() - _failedAt;
+            if (waited < _delay) {
+                return false;
+            }
+
+            _waiting = false;
+            _backoffTime += waited;
+            if (_state == CIRCUIT_OPEN) {
+                _state = CIRCUIT_HALF_OPEN;
+            }
+            return true;
+        }
+
+        void success() {
+            _state = CIRCUIT_CLOSED;
+            _consecutiveFailures = 0;
+            _waiting = false;
+        }
+
+        void failure() {
+            _consecutiveFailures++;
+            _totalFailures++;
+
+            if (_state == CIRCUIT_HALF_OPEN || _consecutiveFailures >= _failureThreshold) {
+                _state = CIRCUIT_OPEN;
+            }
+
+            // min * 2^(failures-1), limited to max.
+            uint32_t backoff = _minDelay;
+            for (uint16_t i = 1; i < _consecutiveFailures && backoff < _maxDelay; i++) {
+                backoff *= 2;
+            }
+            backoff = min(backoff, _maxDelay);
+            _delay = random(backoff / 2, backoff + 1);
+            _failedAt = millis();
+            _waiting = true;
+        }
+
+        _CircuitState getState() {
+            return _state;
+        }
+
+        bool isHalfOpen() {
+            return _state == CIRCUIT_HALF_OPEN;
+        }
+
+        uint16_t getConsecutiveFailures() {
+            return _consecutiveFailures;
+        }
+
+        uint32_t getTotalFailures() {
+            return _totalFailures;
+        }
+
+        // Time until the next attempt can be made, in milliseconds. 0 if it can be made now.
+        uint32_t getRetryIn() {
+            unsigned long waited = millis() - _failedAt;
+            if (!_waiting || waited >= _delay) {
+                return 0;
+            }
+            return _delay - waited;
+        }
+
+        // Total time spent in backoff, including the current one, in seconds.
+        uint32_t getBackoffTime() {
+            unsigned long backoffTime = _backoffTime;
+            if (_waiting) {
+                backoffTime += millis() - _failedAt;
+            }
+            return backoffTime / 1000;
+        }
+
+        // Human readable status, like 'open, 5 failures, retry in 40s, 320s in backoff'.
+        void getStatus(char* buffer, size_t size) {
+            const char* states[] = {"closed", "open", "half open"};
+            snprintf(
+                buffer,
+                size,
+                "%s, %u failures, retry in %lus, %lus in backoff",
+                states[_state],
+                _consecutiveFailures,
+                (unsigned long)(getRetryIn() / 1000),
+                (unsigned long)getBackoffTime());
+        }
+
+    private:
+        uint32_t _minDelay;
+        uint32_t _maxDelay;
+        uint8_t _failureThreshold;
+
+        _CircuitState _state = CIRCUIT_CLOSED;
+        bool _waiting = false;
+        unsigned long _failedAt = 0;
+        uint32_t _delay = 0;
+
+        uint16_t _consecutiveFailures = 0;
+        uint32_t _totalFailures = 0;
+        unsigned long _backoffTime = 0;
+};
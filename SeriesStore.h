@@ -0,0 +1,479 @@
+#pragma once
+
+#include "Arduino.h"
+#include "TelemetrySource.h"
+#include "TelemetryBuffer.h"
+#include "FastFormat.h"
+#include "TelemetryNames.h"
+
+// Maximum number of series. Each metric, or point field, with its precision is a series.
+#ifndef SERIES_MAX_COUNT
+#define SERIES_MAX_COUNT 32
+#endif
+
+// The series data is kept in linked blocks of that size, allocated from a shared pool.
+#ifndef SERIES_BLOCK_SIZE
+#define SERIES_BLOCK_SIZE 32
+#endif
+
+#define SERIES_BLOCK_BITS ((SERIES_BLOCK_SIZE - 2) * 8)
+#define SERIES_NO_BLOCK 0xFFFF
+#define SERIES_NO_NAME 0xFF
+
+struct SeriesBlock {
+    uint16_t next;
+    uint8_t data[SERIES_BLOCK_SIZE - 2];
+};
+
+// Encoder or decoder position in a series stream and the values it needs for the next sample.
+struct SeriesState {
+    uint16_t block;
+    uint8_t bit;
+    uint16_t index;         // Samples since the series start.
+    uint32_t timestamp;     // Last timestamp.
+    int32_t delta;          // Last timestamp delta.
+    uint32_t value;         // Last value bits.
+    uint8_t leading;        // Leading zeros of the last XOR window.
+    uint8_t trailing;       // Trailing zeros of the last XOR window.
+};
+
+struct Series {
+    uint8_t name;           // Metric or point measurement.
+    uint8_t tags;           // Tag set or SERIES_NO_NAME.
+    uint8_t field;          // Point field or SERIES_NO_NAME for the 'value' field.
+    uint8_t precision;
+    bool timestamped;
+    uint16_t count;         // Samples after the start state.
+    SeriesState start;      // Decoder state at the oldest sample.
+    SeriesState end;        // Encoder state after the newest sample.
+};
+
+/*
+ * Compressed telemetry store, based on the Facebook Gorilla time series encoding.
+ *
+ * Each series is a separate bit stream. Timestamps are stored as delta-of-delta - on regular
+ * collect interval it is 0 and takes a single bit. Values are XOR-ed with the previous one - an
+ * unchanged value takes a single bit and a slowly changing one only its changed bits. For slowly
+ * changing sensor data this is 2-20 bits per sample, instead of 64 bits for TelemetryBuffer.
+ *
+ * The line protocol is decoded at push time, series by series. Same interface as TelemetryBuffer,
+ * define TELEMETRY_SERIES_STORE to use it in the InfluxDBCollector.
+ */
+class SeriesStore : public TelemetrySource {
+    public:
+        // The src tag value is read on each render, so it follows the hostname changes.
+        SeriesStore(const char* src) {
+            _src = src;
+            clear();
+        }
+
+        bool append(const char* metric, float value, uint8_t precision, uint32_t timestamp) {
+            int16_t name = _names.intern(metric);
+            if (name < 0) {
+                return false;
+            }
+
+            int16_t series = findSeries(name, SERIES_NO_NAME, SERIES_NO_NAME, precision, timestamp > 0);
+            if (series < 0) {
+                return false;
+            }
+
+            encode(&_series[series], value, timestamp);
+            return true;
+        }
+
+        // Append a point with multiple fields. Each field is stored as a separate series and pushed
+        // as a separate line. Either the whole point is appended or nothing.
+        bool appendPoint(const char* measurement,
+                         const char* tags,
+                         TelemetryField* fields,
+                         uint8_t count,
+                         uint32_t timestamp) {
+            if (count == 0 || count > TELEMETRY_MAX_POINT_FIELDS) {
+                return count == 0;
+            }
+
+            int16_t name = _names.intern(measurement);
+            int16_t tagsId = (tags != NULL && tags[0] != '\0') ? _names.intern(tags) : SERIES_NO_NAME;
+            if (name < 0 || tagsId < 0 || _freeCount < 2 * count) {
+                return false;
+            }
+
+            // The series created for the point are removed if any of its fields can't be stored.
+            uint8_t seriesCount = _seriesCount;
+            int16_t series[TELEMETRY_MAX_POINT_FIELDS];
+            for (uint8_t i = 0; i < count; i++) {
+                int16_t field = _names.intern(fields[i].name);
+                series[i] = field < 0 ? -1 : findSeries(name, tagsId, field, fields[i].precision, timestamp > 0);
+                if (series[i] < 0) {
+                    removeSeries(seriesCount);
+                    return false;
+                }
+            }
+
+            for (uint8_t i = 0; i < count; i++) {
+                encode(&_series[series[i]], fields[i].value, timestamp);
+            }
+            return true;
+        }
+
+        void rewind() override {
+            _cursorSeries = 0;
+            _cursorCount = 0;
+            if (_seriesCount > 0) {
+                _cursor = _series[0].start;
+            }
+        }
+
+        bool available() override {
+            if (_cursorSeries + 1 < _seriesCount) {
+                return true;
+            }
+            return _cursorSeries < _seriesCount && _cursorCount < _series[_cursorSeries].count;
+        }
+
+        size_t read(char* buffer, size_t size) override {
+            size_t pos = 0;
+
+            while (_cursorSeries < _seriesCount) {
+                Series* series = &_series[_cursorSeries];
+                if (_cursorCount >= series->count) {
+                    _cursorSeries++;
+                    _cursorCount = 0;
+                    if (_cursorSeries < _seriesCount) {
+                        _cursor = _series[_cursorSeries].start;
+                    }
+                    continue;
+                }
+
+                SeriesState state = _cursor;
+                uint32_t timestamp;
+                float value;
+                decode(series, &state, timestamp, value);
+
+                size_t lineSize = render(series, timestamp, value, buffer + pos, size - pos);
+                if (lineSize == 0 && pos > 0) {
+                    break;
+                }
+
+                // A line that doesn't fit even in an empty buffer is skipped.
+                pos += lineSize;
+                _cursor = state;
+                _cursorCount++;
+            }
+
+            return pos;
+        }
+
+        void commit() override {
+            uint8_t consumed = _cursorSeries;
+            if (_cursorSeries < _seriesCount) {
+                Series* series = &_series[_cursorSeries];
+                if (_cursorCount >= series->count) {
+                    consumed++;
+                } else if (_cursorCount > 0) {
+                    // Partially read series. Free the read blocks and continue from the cursor.
+                    uint16_t block = series->start.block;
+                    while (block != _cursor.block) {
+                        uint16_t next = _blocks[block].next;
+                        freeBlock(block);
+                        block = next;
+                    }
+                    series->start = _cursor;
+                    series->count -= _cursorCount;
+                }
+            }
+
+            for (uint8_t i = 0; i < consumed; i++) {
+                uint16_t block = _series[i].start.block;
+                while (block != SERIES_NO_BLOCK) {
+                    uint16_t next = _blocks[block].next;
+                    freeBlock(block);
+                    block = next;
+                }
+            }
+
+            if (consumed > 0) {
+                memmove(_series, _series + consumed, (_seriesCount - consumed) * sizeof(Series));
+                _seriesCount -= consumed;
+            }
+
+            if (_seriesCount == 0) {
+                clear();
+            } else {
+                rewind();
+            }
+        }
+
+        void clear() {
+            for (uint16_t i = 0; i < capacity(); i++) {
+                _blocks[i].next = i + 1 < capacity() ? i + 1 : SERIES_NO_BLOCK;
+            }
+            _free = 0;
+            _freeCount = capacity();
+            _seriesCount = 0;
+            _names.clear();
+            rewind();
+        }
+
+        // Used blocks.
+        uint16_t size() {
+            return capacity() - _freeCount;
+        }
+
+        uint16_t capacity() {
+            return sizeof(_blocks) / sizeof(SeriesBlock);
+        }
+
+        bool isEmpty() {
+            return _seriesCount == 0;
+        }
+
+    private:
+        // Find the series or create new one. Returns -1 if there is no space for a sample in it.
+        int16_t findSeries(uint8_t name, uint8_t tags, uint8_t field, uint8_t precision, bool timestamped) {
+            // The largest sample is below 100 bits, so a single new block is always enough.
+            for (uint8_t i = 0; i < _seriesCount; i++) {
+                Series* series = &_series[i];
+                if (series->name == name &&
+                    series->tags == tags &&
+                    series->field == field &&
+                    series->precision == precision &&
+                    series->timestamped == timestamped) {
+                    return _freeCount >= 1 ? i : -1;
+                }
+            }
+
+            if (_seriesCount >= SERIES_MAX_COUNT || _freeCount < 2) {
+                return -1;
+            }
+
+            Series* series = &_series[_seriesCount];
+            series->name = name;
+            series->tags = tags;
+            series->field = field;
+            series->precision = precision;
+            series->timestamped = timestamped;
+            series->count = 0;
+            memset(&series->start, 0, sizeof(SeriesState));
+            series->start.block = allocateBlock();
+            series->end = series->start;
+            return _seriesCount++;
+        }
+
+        // Remove the series after the first count ones. Only for the empty ones just created.
+        void removeSeries(uint8_t count) {
+            while (_seriesCount > count) {
+                freeBlock(_series[--_seriesCount].start.block);
+            }
+        }
+
+        void encode(Series* series, float value, uint32_t timestamp) {
+            SeriesState* state = &series->end;
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+
+            if (state->index == 0) {
+                if (series->timestamped) {
+                    writeBits(state, timestamp, 32);
+                }
+                writeBits(state, bits, 32);
+                // No XOR window yet.
+                state->leading = 0xFF;
+            } else {
+                if (series->timestamped) {
+                    int32_t delta = timestamp - state->timestamp;
+                    int32_t deltaOfDelta = delta - state->delta;
+                    if (deltaOfDelta == 0) {
+                        writeBits(state, 0b0, 1);
+                    } else if (deltaOfDelta >= -63 && deltaOfDelta <= 64) {
+                        writeBits(state, 0b10, 2);
+                        writeBits(state, deltaOfDelta + 63, 7);
+                    } else if (deltaOfDelta >= -255 && deltaOfDelta <= 256) {
+                        writeBits(state, 0b110, 3);
+                        writeBits(state, deltaOfDelta + 255, 9);
+                    } else if (deltaOfDelta >= -2047 && deltaOfDelta <= 2048) {
+                        writeBits(state, 0b1110, 4);
+                        writeBits(state, deltaOfDelta + 2047, 12);
+                    } else {
+                        writeBits(state, 0b1111, 4);
+                        writeBits(state, deltaOfDelta, 32);
+                    }
+                    state->delta = delta;
+                }
+
+                uint32_t xored = bits ^ state->value;
+                if (xored == 0) {
+                    writeBits(state, 0b0, 1);
+                } else {
+                    uint8_t leading = __builtin_clz(xored);
+                    uint8_t trailing = __builtin_ctz(xored);
+                    if (state->leading != 0xFF && leading >= state->leading && trailing >= state->trailing) {
+                        // Fits in the previous window.
+                        writeBits(state, 0b10, 2);
+                        writeBits(state, xored >> state->trailing, 32 - state->leading - state->trailing);
+                    } else {
+                        uint8_t length = 32 - leading - trailing;
+                        writeBits(state, 0b11, 2);
+                        writeBits(state, leading, 5);
+                        writeBits(state, length - 1, 5);
+                        writeBits(state, xored >> trailing, length);
+                        state->leading = leading;
+                        state->trailing = trailing;
+                    }
+                }
+            }
+
+            state->timestamp = timestamp;
+            state->value = bits;
+            state->index++;
+            series->count++;
+        }
+
+        void decode(Series* series, SeriesState* state, uint32_t& timestamp, float& value) {
+            uint32_t bits;
+
+            if (state->index == 0) {
+                if (series->timestamped) {
+                    state->timestamp = readBits(state, 32);
+                }
+                bits = readBits(state, 32);
+                state->leading = 0xFF;
+            } else {
+                if (series->timestamped) {
+                    int32_t deltaOfDelta;
+                    if (readBits(state, 1) == 0) {
+                        deltaOfDelta = 0;
+                    } else if (readBits(state, 1) == 0) {
+                        deltaOfDelta = (int32_t)readBits(state, 7) - 63;
+                    } else if (readBits(state, 1) == 0) {
+                        deltaOfDelta = (int32_t)readBits(state, 9) - 255;
+                    } else if (readBits(state, 1) == 0) {
+                        deltaOfDelta = (int32_t)readBits(state, 12) - 2047;
+                    } else {
+                        deltaOfDelta = readBits(state, 32);
+                    }
+                    state->delta += deltaOfDelta;
+                    state->timestamp += state->delta;
+                }
+
+                bits = state->value;
+                if (readBits(state, 1) == 1) {
+                    if (readBits(state, 1) == 1) {
+                        state->leading = readBits(state, 5);
+                        uint8_t length = readBits(state, 5) + 1;
+                        state->trailing = 32 - state->leading - length;
+                    }
+                    uint8_t length = 32 - state->leading - state->trailing;
+                    bits ^= readBits(state, length) << state->trailing;
+                }
+            }
+
+            state->value = bits;
+            state->index++;
+            timestamp = series->timestamped ? state->timestamp : 0;
+            memcpy(&value, &bits, sizeof(value));
+        }
+
+        // Write the lowest count bits of the value, most significant first.
+        void writeBits(SeriesState* state, uint32_t value, uint8_t count) {
+            while (count > 0) {
+                if (state->bit == SERIES_BLOCK_BITS) {
+                    uint16_t block = allocateBlock();
+                    _blocks[state->block].next = block;
+                    state->block = block;
+                    state->bit = 0;
+                }
+
+                count--;
+                uint8_t* byte = &_blocks[state->block].data[state->bit / 8];
+                uint8_t mask = 0x80 >> (state->bit % 8);
+                if ((value >> count) & 1) {
+                    *byte |= mask;
+                } else {
+                    *byte &= ~mask;
+                }
+                state->bit++;
+            }
+        }
+
+        uint32_t readBits(SeriesState* state, uint8_t count) {
+            uint32_t value = 0;
+            while (count > 0) {
+                if (state->bit == SERIES_BLOCK_BITS) {
+                    state->block = _blocks[state->block].next;
+                    state->bit = 0;
+                }
+
+                count--;
+                uint8_t byte = _blocks[state->block].data[state->bit / 8];
+                value = (value << 1) | ((byte >> (7 - state->bit % 8)) & 1);
+                state->bit++;
+            }
+            return value;
+        }
+
+        uint16_t allocateBlock() {
+            uint16_t block = _free;
+            _free = _blocks[block].next;
+            _freeCount--;
+            _blocks[block].next = SERIES_NO_BLOCK;
+            return block;
+        }
+
+        void freeBlock(uint16_t block) {
+            _blocks[block].next = _free;
+            _free = block;
+            _freeCount++;
+        }
+
+        // Render a sample as line protocol. Returns the line size or 0 if it doesn't fit.
+        size_t render(Series* series, uint32_t timestamp, float value, char* buffer, size_t size) {
+            size_t pos = 0;
+
+            // name,src=host[,tags] field=X [timestamp]
+            pos += FastFormat::formatString(buffer + pos, remaining(pos, size), _names.get(series->name));
+            pos += FastFormat::formatString(buffer + pos, remaining(pos, size), ",src=");
+            pos += FastFormat::formatString(buffer + pos, remaining(pos, size), _src);
+            if (series->tags != SERIES_NO_NAME) {
+                pos += FastFormat::formatString(buffer + pos, remaining(pos, size), ",");
+                pos += FastFormat::formatString(buffer + pos, remaining(pos, size), _names.get(series->tags));
+            }
+            pos += FastFormat::formatString(buffer + pos, remaining(pos, size), " ");
+            pos += FastFormat::formatString(
+                buffer + pos,
+                remaining(pos, size),
+                series->field != SERIES_NO_NAME ? _names.get(series->field) : "value");
+            pos += FastFormat::formatString(buffer + pos, remaining(pos, size), "=");
+            pos += FastFormat::formatFloat(buffer + pos, remaining(pos, size), value, series->precision);
+            if (series->timestamped) {
+                pos += FastFormat::formatString(buffer + pos, remaining(pos, size), " ");
+                pos += FastFormat::formatUnsigned(buffer + pos, remaining(pos, size), timestamp);
+            }
+
+            if (pos >= size) {
+                return 0;
+            }
+            buffer[pos++] = '\n';
+            return pos;
+        }
+
+        size_t remaining(size_t pos, size_t size) {
+            return pos < size ? size - pos : 0;
+        }
+
+        SeriesBlock _blocks[TELEMETRY_BUFFER_SIZE / sizeof(SeriesBlock)];
+        uint16_t _free;
+        uint16_t _freeCount;
+
+        Series _series[SERIES_MAX_COUNT];
+        uint8_t _seriesCount;
+
+        // Read cursor - series index, decoder state and the samples read from the series.
+        uint8_t _cursorSeries;
+        SeriesState _cursor;
+        uint16_t _cursorCount;
+
+        TelemetryNames _names;
+        const char* _src;
+};
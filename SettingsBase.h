@@ -1,9 +1,14 @@
 #pragma once
 
 #include "Logger.h"
+#include "RTCSampleLog.h"
 #include <EEPROM.h>
 
 template <class T_EEPROM, class T_RTC> class SettingsBase {
+    // The RTC sample log and the RTC log tail follow the RTC settings.
+    static_assert(4 + sizeof(T_RTC) <= RTC_SAMPLE_LOG_OFFSET * 4,
+                  "The RTC settings overlap the RTC sample log, raise RTC_SAMPLE_LOG_OFFSET");
+
     public:
         SettingsBase(Logger* logger) {
             _logger = logger;
@@ -11,9 +16,9 @@ template <class T_EEPROM, class T_RTC> class SettingsBase {
 
         void begin() {
             if (readEEPROM()) {
-                _logger->log("Settings loaded successfully");
+                _logger->info(LOG_MODULE_SETTINGS, "Settings loaded successfully");
             } else {
-                _logger->log("Invalid settings checksum");
+                _logger->warn(LOG_MODULE_SETTINGS, "Invalid settings checksum");
                 memset(getSettings(), 0, sizeof(T_EEPROM));
                 initializeSettings();
                 _checksum = calculateEEPROMChecksum();
@@ -21,9 +26,9 @@ template <class T_EEPROM, class T_RTC> class SettingsBase {
 
             if (getRTCSettings() != NULL) {
                 if (readRTC()) {
-                    _logger->log("RTC settings loaded successfully");
+                    _logger->info(LOG_MODULE_SETTINGS, "RTC settings loaded successfully");
                 } else {
-                    _logger->log("Invalid RTC settings checksum");
+                    _logger->warn(LOG_MODULE_SETTINGS, "Invalid RTC settings checksum");
                     memset(getRTCSettings(), 0, sizeof(T_RTC));
                     _rtcChecksum = calculateRTCChecksum();
                 }
@@ -32,13 +37,13 @@ template <class T_EEPROM, class T_RTC> class SettingsBase {
 
         void loop() {
             if (_checksum != calculateEEPROMChecksum()) {
-                _logger->log("Writing settings to EEPROM");
+                _logger->debug(LOG_MODULE_SETTINGS, "Writing settings to EEPROM");
                 writeEEPROM();
             }
 
             if (getRTCSettings() != NULL && _rtcChecksum != calculateRTCChecksum()) {
                 writeRTC();
-                _logger->log("Writing settings to RTC");
+                _logger->debug(LOG_MODULE_SETTINGS, "Writing settings to RTC");
             }            
         }
 
@@ -122,7 +127,7 @@ template <class T_EEPROM, class T_RTC> class SettingsBase {
             ESP.rtcUserMemoryWrite(0, &_rtcChecksum, 4);
             bool res = ESP.rtcUserMemoryWrite(1, (uint32_t*)getRTCSettings(), sizeof(T_RTC));
             if (!res) 
-                _logger->log("Failed to write RTC settings");
+                _logger->error(LOG_MODULE_SETTINGS, "Failed to write RTC settings");
         }
 
         Logger* _logger = NULL;
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+
+#include "Logger.h"
+#include "WiFi.h"
+#include "WebServerBase.h"
+
+const char SYSLOG_CONFIG_PAGE[] PROGMEM = R"=====(
+<fieldset style='display: inline-block; width: 300px'>
+<legend>Syslog settings</legend>
+Log shipping:<br>
+<select name="syslog_enabled">
+<option value="true" %s>Enabled</option>
+<option value="false" %s>Disabled</option>
+</select><br><br>
+Server:<br>
+<input type="text" name="syslog_server" value="%s"><br>
+<small><em>host name or IP of the syslog server</em></small><br><br>
+Port:<br>
+<input type="text" name="syslog_port" value="%d"><br>
+<small><em>UDP port, 514 if 0</em></small><br><br>
+Budget:<br>
+<input type="text" name="syslog_budget" value="%d"><br>
+<small><em>bytes sent per WiFi window, %d if 0</em></small><br><br>
+Status:<br>
+<small><em>%s</em></small><br>
+</fieldset>
+)=====";
+
+// Bytes of messages sent per WiFi window, if not configured. The rest waits for the next window.
+#ifndef SYSLOG_WINDOW_BUDGET
+#define SYSLOG_WINDOW_BUDGET 1024
+#endif
+
+// The new lines wait for a WiFi window of another module for up to that many seconds. Then the
+// sink turns the WiFi on itself.
+#ifndef SYSLOG_MAX_DELAY
+#define SYSLOG_MAX_DELAY 3600
+#endif
+
+// Minimum time between two windows, in seconds. While the WiFi stays on, the lines are still
+// sent in batches.
+#ifndef SYSLOG_MIN_INTERVAL
+#define SYSLOG_MIN_INTERVAL 60
+#endif
+
+// Maximum size of a single message. Longer lines are truncated.
+#ifndef SYSLOG_MESSAGE_SIZE
+#define SYSLOG_MESSAGE_SIZE 192
+#endif
+
+// Facility of the messages, local0 by default.
+#ifndef SYSLOG_FACILITY
+#define SYSLOG_FACILITY 16
+#endif
+
+#define SYSLOG_DEFAULT_PORT 514
+
+struct SyslogSettings {
+    bool enable;
+    char server[64];
+    uint16_t port;
+    uint16_t budget;
+};
+
+/*
+ * Ships the log lines to a syslog server, as RFC 5424 messages over UDP.
+ *
+ * The lines logged since the last window are sent once the WiFi is on for another module, like
+ * the InfluxDBCollector push, so the log shipping doesn't need a radio window of its own. Up to
+ * the budget is sent per window. Each line is a separate datagram, with the severity and the
+ * APP-NAME taken from the level and the module tag of the line. The lines overwritten in the log
+ * buffer before they could be sent are counted as dropped.
+ *
+ * The TIMESTAMP is left empty, the receive time is up to SYSLOG_MAX_DELAY late. The binary log
+ * lines carry the uptime.
+ */
+class SyslogSink {
+    public:
+        SyslogSink(Logger* logger, WiFiManager* wifi, SyslogSettings* settings, NetworkSettings* networkSettings) {
+            _logger = logger;
+            _wifi = wifi;
+            _settings = settings;
+            _networkSettings = networkSettings;
+        }
+
+        void begin() {
+            if (_wifi != NULL) {
+                _wifiModule = _wifi->registerModule("syslog");
+            }
+        }
+
+        void loop() {
+            if (!_settings->enable || strlen(_settings->server) == 0) {
+                // Nothing to catch up with once enabled.
+                _position = _logger->getLineCount();
+                return;
+            }
+            if (_logger->getLineCount() == _position) {
+                return;
+            }
+
+            if (!_scheduled) {
+                schedule();
+            }
+            if (!_acquiring) {
+                if (!isDue()) {
+                    return;
+                }
+                _acquiring = true;
+            }
+            if (_wifi != NULL && !_wifi->acquire(_wifiModule)) {
+                // Waiting for the connection.
+                return;
+            }
+
+            send();
+            _acquiring = false;
+            _scheduled = false;
+            _lastWindow = millis();
+            _windows++;
+            if (_wifi != NULL) {
+                _wifi->unschedule(_wifiModule);
+                _wifi->release(_wifiModule, true);
+            }
+        }
+
+        void get_config_page(char* buffer) {
+            char status[96];
+            snprintf(
+                status,
+                sizeof(status),
+                "%lu lines in %lu windows, %lu bytes, %lu dropped",
+                (unsigned long)_sentLines,
+                (unsigned long)_windows,
+                (unsigned long)_sentBytes,
+                (unsigned long)_dropped);
+            sprintf_P(
+                buffer,
+                SYSLOG_CONFIG_PAGE,
+                (_settings->enable)?"selected":"",
+                (!_settings->enable)?"selected":"",
+                _settings->server,
+                _settings->port,
+                _settings->budget,
+                SYSLOG_WINDOW_BUDGET,
+                status);
+        }
+
+        void parse_config_params(WebServerBase* webServer) {
+            webServer->process_setting("syslog_enabled", _settings->enable);
+            webServer->process_setting("syslog_server", _settings->server, sizeof(_settings->server));
+            webServer->process_setting("syslog_port", _settings->port);
+            webServer->process_setting("syslog_budget", _settings->budget);
+        }
+
+        uint32_t getDropped() {
+            return _dropped;
+        }
+
+    private:
+        // Due at SYSLOG_MAX_DELAY after the first new line, or earlier if the WiFi is on anyway
+        // and SYSLOG_MIN_INTERVAL has passed since the last window.
+        void schedule() {
+            _scheduled = true;
+            if (_wifi == NULL) {
+                return;
+            }
+            unsigned long maxDelay = SYSLOG_MAX_DELAY * 1000UL;
+            unsigned long wait = 0;
+            if (_windows > 0 && millis() - _lastWindow < SYSLOG_MIN_INTERVAL * 1000UL) {
+                wait = SYSLOG_MIN_INTERVAL * 1000UL - (millis() - _lastWindow);
+            }
+            _wifi->schedule(_wifiModule, millis() + maxDelay, wait < maxDelay ? maxDelay - wait : 0);
+        }
+
+        bool isDue() {
+            if (_wifi != NULL && _wifiModule != WIFI_NO_MODULE) {
+                return _wifi->isDue(_wifiModule);
+            }
+            // Without the WiFiManager, only when connected.
+            return WiFi.status() == WL_CONNECTED &&
+                (_windows == 0 || millis() - _lastWindow >= SYSLOG_MIN_INTERVAL * 1000UL);
+        }
+
+        // Send the new lines, up to the budget.
+        void send() {
+            IPAddress ip;
+            if (!WiFi.hostByName(_settings->server, ip)) {
+                _logger->warn(LOG_MODULE_SYSTEM, "Can't resolve the syslog server %s", _settings->server);
+                return;
+            }
+            uint16_t port = _settings->port != 0 ? _settings->port : SYSLOG_DEFAULT_PORT;
+            size_t budget = max((size_t)(_settings->budget != 0 ? _settings->budget : SYSLOG_WINDOW_BUDGET),
+                                (size_t)SYSLOG_MESSAGE_SIZE);
+
+            size_t sent = 0;
+            _dropped += _logger->readLines(_position, [&](const char* line, size_t length) {
+                char message[SYSLOG_MESSAGE_SIZE];
+                size_t size = format(message, sizeof(message), line);
+                if (sent + size > budget) {
+                    return false;
+                }
+                if (!_udp.beginPacket(ip, port) ||
+                    _udp.write((uint8_t*)message, size) != size ||
+                    !_udp.endPacket()) {
+                    return false;
+                }
+                sent += size;
+                _sentLines++;
+                return true;
+            });
+            _sentBytes += sent;
+        }
+
+        // Like '<132>1 - node-1 wifi - - - Quick connect failed'. The lines without a module tag
+        // are sent as notices.
+        size_t format(char* message, size_t size, const char* line) {
+            // The uptime of the binary log lines stays in the message.
+            const char* text = line;
+            while (isdigit(*text) || *text == '.') {
+                text++;
+            }
+            text = text != line && *text == ' ' ? text + 1 : line;
+
+            uint8_t severity = 5;
+            char app[16] = "-";
+            const char* rest = text;
+            const char* end = text[0] != '\0' && text[1] == ' ' && text[2] == '[' ? strchr(text + 3, ']') : NULL;
+            if (end != NULL && end[1] == ' ' && (size_t)(end - text - 3) < sizeof(app)) {
+                switch (text[0]) {
+                    case 'D': severity = 7; break;
+                    case 'I': severity = 6; break;
+                    case 'W': severity = 4; break;
+                    case 'E': severity = 3; break;
+                }
+                memcpy(app, text + 3, end - text - 3);
+                app[end - text - 3] = '\0';
+                rest = end + 2;
+            }
+
+            int length = snprintf(
+                message,
+                size,
+                "<%d>1 - %s %s - - - %.*s%s",
+                SYSLOG_FACILITY * 8 + severity,
+                strlen(_networkSettings->hostname) > 0 ? _networkSettings->hostname : "-",
+                app,
+                (int)(text - line),
+                line,
+                rest);
+            return min((size_t)max(length, 0), size - 1);
+        }
+
+        Logger* _logger;
+        WiFiManager* _wifi;
+        SyslogSettings* _settings;
+        NetworkSettings* _networkSettings;
+        uint8_t _wifiModule = WIFI_NO_MODULE;
+        WiFiUDP _udp;
+
+        // Position of the next line to send, see Logger::readLines().
+        uint32_t _position = 0;
+        bool _scheduled = false;
+        bool _acquiring = false;
+        unsigned long _lastWindow = 0;
+
+        uint32_t _windows = 0;
+        uint32_t _sentLines = 0;
+        uint32_t _sentBytes = 0;
+        uint32_t _dropped = 0;
+};
@@ -23,12 +23,12 @@ class SystemCheck {
             }
 
             if (hasTimeoutOccur(lastWebCall, 600)) {
-                logger->log("Reseting based on the lastWebCall timestamp!");
+                logger->error(LOG_MODULE_SYSTEM, "Reseting based on the lastWebCall timestamp!");
                 ESP.reset();
             }
 
             if (hasTimeoutOccur(lastWiFiConnectedState, 120)) {
-                logger->log("Reseting based on the lastWiFiConnectedState timestamp!");
+                logger->error(LOG_MODULE_SYSTEM, "Reseting based on the lastWiFiConnectedState timestamp!");
                 ESP.reset();
             }
         }
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Arduino.h"
+#include "TelemetryBuffer.h"
+#include "TelemetryNames.h"
+
+// Maximum number of metrics aggregated at the same time.
+#ifndef TELEMETRY_MAX_AGGREGATES
+#define TELEMETRY_MAX_AGGREGATES 16
+#endif
+
+// Number of fields of an aggregated point - min, max, mean, last and count.
+#define TELEMETRY_AGGREGATE_FIELDS 5
+
+struct TelemetryAggregate {
+    char metric[TELEMETRY_METRIC_NAME_SIZE];
+    uint8_t precision;
+    float min;
+    float max;
+    float sum;
+    float last;
+    uint16_t count;
+};
+
+/*
+ * Windowed aggregation of the collected values.
+ *
+ * Keeps running statistics for each metric during the window. At the end of the window each
+ * metric gives a single point with min, max, mean, last and count fields, instead of a sample for
+ * each collected value.
+ */
+class TelemetryAggregator {
+    public:
+        // Add the value to the metric statistics. Returns false if there is no free slot for the
+        // metric.
+        bool add(const char* metric, float value, uint8_t precision) {
+            TelemetryAggregate* aggregate = NULL;
+            for (uint8_t i = 0; i < _count; i++) {
+                if (_aggregates[i].precision == precision && strcmp(_aggregates[i].metric, metric) == 0) {
+                    aggregate = &_aggregates[i];
+                    break;
+                }
+            }
+
+            if (aggregate == NULL) {
+                if (_count >= TELEMETRY_MAX_AGGREGATES || strlen(metric) >= TELEMETRY_METRIC_NAME_SIZE) {
+                    return false;
+                }
+                aggregate = &_aggregates[_count++];
+                strcpy(aggregate->metric, metric);
+                aggregate->precision = precision;
+                aggregate->min = value;
+                aggregate->max = value;
+                aggregate->sum = 0;
+                aggregate->count = 0;
+            }
+
+            aggregate->min = min(aggregate->min, value);
+            aggregate->max = max(aggregate->max, value);
+            aggregate->sum += value;
+            aggregate->last = value;
+            aggregate->count++;
+            return true;
+        }
+
+        uint8_t size() {
+            return _count;
+        }
+
+        const char* getMetric(uint8_t index) {
+            return _aggregates[index].metric;
+        }
+
+        // Fill the point fields for the metric at the specified index. The fields should have
+        // space for TELEMETRY_AGGREGATE_FIELDS items.
+        uint8_t getFields(uint8_t index, TelemetryField* fields) {
+            TelemetryAggregate* aggregate = &_aggregates[index];
+            fields[0] = {"min", aggregate->min, aggregate->precision};
+            fields[1] = {"max", aggregate->max, aggregate->precision};
+            // One more digit for the mean, it is more precise than the collected values.
+            fields[2] = {"mean", aggregate->sum / aggregate->count, (uint8_t)(aggregate->precision + 1)};
+            fields[3] = {"last", aggregate->last, aggregate->precision};
+            fields[4] = {"count", (float)aggregate->count, 0};
+            return TELEMETRY_AGGREGATE_FIELDS;
+        }
+
+        // Start a new window.
+        void clear() {
+            _count = 0;
+        }
+
+    private:
+        TelemetryAggregate _aggregates[TELEMETRY_MAX_AGGREGATES];
+        uint8_t _count = 0;
+};
@@ -0,0 +1,311 @@
+#pragma once
+
+#include "Arduino.h"
+#include "TelemetrySource.h"
+#include "FastFormat.h"
+#include "TelemetryNames.h"
+
+// Size of the in-memory buffer. The bigger, the better. But consider the available RAM.
+#ifndef TELEMETRY_BUFFER_SIZE
+#define TELEMETRY_BUFFER_SIZE 24 * 1024
+#endif
+
+// Maximum number of fields in a multi-field point.
+#ifndef TELEMETRY_MAX_POINT_FIELDS
+#define TELEMETRY_MAX_POINT_FIELDS 16
+#endif
+
+// Metric id of a record that carries the absolute timestamp for the records following it.
+#define TELEMETRY_BASE_RECORD 0xFF
+// Delta value of a record that has no timestamp. The server time is used for such records.
+#define TELEMETRY_NO_TIMESTAMP 0xFFFF
+// Precision flag of a record that starts a multi-field point. It is followed by its field records.
+#define TELEMETRY_POINT_RECORD 0x80
+// Tags value of a point without extra tags.
+#define TELEMETRY_NO_TAGS 0xFF
+
+struct TelemetryRecord {
+    uint8_t metric;         // Index in the names table or TELEMETRY_BASE_RECORD.
+    uint8_t precision;      // Number of digits after the decimal point or TELEMETRY_POINT_RECORD.
+    uint16_t delta;         // Seconds since the last base record or TELEMETRY_NO_TIMESTAMP.
+    union {
+        float value;
+        uint32_t timestamp; // Used by the base records.
+        struct {
+            uint8_t tags;   // Index of the tag set in the names table or TELEMETRY_NO_TAGS.
+            uint8_t fields; // Number of the field records following the point record.
+        } point;
+    };
+};
+
+struct TelemetryField {
+    const char* name;
+    float value;
+    uint8_t precision;
+};
+
+/*
+ * Compact telemetry store.
+ *
+ * Samples are kept in a ring of fixed size binary records - interned metric id, timestamp delta
+ * and the raw float value. Line protocol is rendered only when the data is read for pushing. A
+ * record takes 8 bytes, while the same sample rendered as line protocol takes 40-60 bytes.
+ */
+class TelemetryBuffer : public TelemetrySource {
+    public:
+        // The src tag value is read on each render, so it follows the hostname changes.
+        TelemetryBuffer(const char* src) {
+            _src = src;
+            clear();
+        }
+
+        bool append(const char* metric, float value, uint8_t precision, uint32_t timestamp) {
+            int16_t id = _names.intern(metric);
+            if (id < 0) {
+                return false;
+            }
+
+            uint16_t delta;
+            if (!reserve(1, timestamp, delta)) {
+                return false;
+            }
+
+            TelemetryRecord* record = &_records[(_head + _count) % capacity()];
+            record->metric = id;
+            record->precision = precision;
+            record->delta = delta;
+            record->value = value;
+            _count++;
+            return true;
+        }
+
+        // Append a point with multiple fields. It is rendered as a single line. The tags are
+        // optional, like 'room=kitchen,floor=1'. Either the whole point is appended or nothing.
+        bool appendPoint(const char* measurement,
+                         const char* tags,
+                         TelemetryField* fields,
+                         uint8_t count,
+                         uint32_t timestamp) {
+            if (count == 0 || count > TELEMETRY_MAX_POINT_FIELDS) {
+                return count == 0;
+            }
+
+            int16_t id = _names.intern(measurement);
+            int16_t tagsId = (tags != NULL && tags[0] != '\0') ? _names.intern(tags) : TELEMETRY_NO_TAGS;
+            if (id < 0 || tagsId < 0) {
+                return false;
+            }
+            int16_t fieldIds[TELEMETRY_MAX_POINT_FIELDS];
+            for (uint8_t i = 0; i < count; i++) {
+                fieldIds[i] = _names.intern(fields[i].name);
+                if (fieldIds[i] < 0) {
+                    return false;
+                }
+            }
+
+            uint16_t delta;
+            if (!reserve(1 + count, timestamp, delta)) {
+                return false;
+            }
+
+            TelemetryRecord* record = &_records[(_head + _count) % capacity()];
+            record->metric = id;
+            record->precision = TELEMETRY_POINT_RECORD;
+            record->delta = delta;
+            record->point.tags = tagsId;
+            record->point.fields = count;
+            _count++;
+
+            for (uint8_t i = 0; i < count; i++) {
+                record = &_records[(_head + _count) % capacity()];
+                record->metric = fieldIds[i];
+                record->precision = fields[i].precision;
+                record->delta = delta;
+                record->value = fields[i].value;
+                _count++;
+            }
+            return true;
+        }
+
+        void rewind() override {
+            _cursor = 0;
+            _cursorBaseValid = false;
+        }
+
+        bool available() override {
+            return _cursor < _count;
+        }
+
+        size_t read(char* buffer, size_t size) override {
+            size_t pos = 0;
+
+            while (_cursor < _count) {
+                TelemetryRecord* record = &_records[(_head + _cursor) % capacity()];
+                if (record->metric == TELEMETRY_BASE_RECORD) {
+                    _cursorBase = record->timestamp;
+                    _cursorBaseValid = true;
+                    _cursor++;
+                    continue;
+                }
+
+                uint16_t records = 1;
+                if (record->precision == TELEMETRY_POINT_RECORD) {
+                    records += record->point.fields;
+                }
+
+                size_t lineSize = render(_cursor, buffer + pos, size - pos);
+                if (lineSize == 0) {
+                    if (pos == 0) {
+                        // Doesn't fit even in an empty buffer, skip it. Otherwise the buffer will
+                        // get stuck on it.
+                        _cursor += records;
+                        continue;
+                    }
+                    break;
+                }
+
+                pos += lineSize;
+                _cursor += records;
+            }
+
+            return pos;
+        }
+
+        void commit() override {
+            if (_cursor == 0) {
+                return;
+            }
+
+            _head = (_head + _cursor) % capacity();
+            _count -= _cursor;
+            _cursor = 0;
+
+            if (_count == 0) {
+                clear();
+                return;
+            }
+
+            if (_cursorBaseValid && _records[_head].metric != TELEMETRY_BASE_RECORD) {
+                // The base for the remaining records was dropped. Put it back in the slot just
+                // before the head, it has been freed by this commit.
+                _head = (_head + capacity() - 1) % capacity();
+                _records[_head].metric = TELEMETRY_BASE_RECORD;
+                _records[_head].timestamp = _cursorBase;
+                _count++;
+            }
+            _cursorBaseValid = false;
+        }
+
+        void clear() {
+            _head = 0;
+            _count = 0;
+            _cursor = 0;
+            _baseValid = false;
+            _cursorBaseValid = false;
+            _names.clear();
+        }
+
+        uint16_t size() {
+            return _count;
+        }
+
+        uint16_t capacity() {
+            return sizeof(_records) / sizeof(TelemetryRecord);
+        }
+
+        bool isEmpty() {
+            return _count == 0;
+        }
+
+    private:
+        // Reserve space for the specified number of records, adding a base record if needed.
+        // Calculates the timestamp delta relative to the base.
+        bool reserve(uint16_t records, uint32_t timestamp, uint16_t& delta) {
+            delta = TELEMETRY_NO_TIMESTAMP;
+            if (timestamp == 0) {
+                return _count + records <= capacity();
+            }
+
+            if (!_baseValid || timestamp < _base || timestamp - _base >= TELEMETRY_NO_TIMESTAMP) {
+                // The delta doesn't fit in the record, start a new base.
+                if (_count + 1 + records > capacity()) {
+                    return false;
+                }
+                TelemetryRecord* base = &_records[(_head + _count) % capacity()];
+                base->metric = TELEMETRY_BASE_RECORD;
+                base->timestamp = timestamp;
+                _count++;
+                _base = timestamp;
+                _baseValid = true;
+            } else if (_count + records > capacity()) {
+                return false;
+            }
+
+            delta = timestamp - _base;
+            return true;
+        }
+
+        // Render the line for the record at the specified position. Returns the line size or 0 if
+        // it doesn't fit in the buffer.
+        size_t render(uint16_t index, char* buffer, size_t size) {
+            TelemetryRecord* record = &_records[(_head + index) % capacity()];
+            size_t pos = 0;
+
+            if (record->precision == TELEMETRY_POINT_RECORD) {
+                // measurement,src=host[,tags] field1=value1,field2=value2 [timestamp]
+                pos += FastFormat::formatString(buffer + pos, remaining(pos, size), _names.get(record->metric));
+                pos += FastFormat::formatString(buffer + pos, remaining(pos, size), ",src=");
+                pos += FastFormat::formatString(buffer + pos, remaining(pos, size), _src);
+                if (record->point.tags != TELEMETRY_NO_TAGS) {
+                    pos += FastFormat::formatString(buffer + pos, remaining(pos, size), ",");
+                    pos += FastFormat::formatString(buffer + pos, remaining(pos, size), _names.get(record->point.tags));
+                }
+                for (uint8_t i = 1; i <= record->point.fields; i++) {
+                    TelemetryRecord* field = &_records[(_head + index + i) % capacity()];
+                    pos += FastFormat::formatString(buffer + pos, remaining(pos, size), i == 1 ? " " : ",");
+                    pos += FastFormat::formatString(buffer + pos, remaining(pos, size), _names.get(field->metric));
+                    pos += FastFormat::formatString(buffer + pos, remaining(pos, size), "=");
+                    pos += FastFormat::formatFloat(buffer + pos, remaining(pos, size), field->value, field->precision);
+                }
+            } else {
+                // metric,src=host value=X [timestamp]
+                pos += FastFormat::formatString(buffer + pos, remaining(pos, size), _names.get(record->metric));
+                pos += FastFormat::formatString(buffer + pos, remaining(pos, size), ",src=");
+                pos += FastFormat::formatString(buffer + pos, remaining(pos, size), _src);
+                pos += FastFormat::formatString(buffer + pos, remaining(pos, size), " value=");
+                pos += FastFormat::formatFloat(buffer + pos, remaining(pos, size), record->value, record->precision);
+            }
+
+            if (record->delta != TELEMETRY_NO_TIMESTAMP && _cursorBaseValid) {
+                pos += FastFormat::formatString(buffer + pos, remaining(pos, size), " ");
+                pos += FastFormat::formatUnsigned(buffer + pos, remaining(pos, size), _cursorBase + record->delta);
+            }
+
+            if (pos >= size) {
+                return 0;
+            }
+            buffer[pos++] = '\n';
+            return pos;
+        }
+
+        size_t remaining(size_t pos, size_t size) {
+            return pos < size ? size - pos : 0;
+        }
+
+        TelemetryRecord _records[TELEMETRY_BUFFER_SIZE / sizeof(TelemetryRecord)];
+        uint16_t _head;
+        uint16_t _count;
+
+        // The last base record appended.
+        uint32_t _base;
+        bool _baseValid;
+
+        // Read cursor, relative to the head, and the base in effect at it.
+        uint16_t _cursor;
+        uint32_t _cursorBase;
+        bool _cursorBaseValid;
+
+        TelemetryNames _names;
+
+        const char* _src;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Arduino.h"
+#include "TelemetryNames.h"
+
+// Maximum number of metrics with deadband.
+#ifndef TELEMETRY_MAX_DEADBANDS
+#define TELEMETRY_MAX_DEADBANDS 16
+#endif
+
+// Default maximum time without a recorded value, in seconds.
+#ifndef TELEMETRY_DEADBAND_HEARTBEAT
+#define TELEMETRY_DEADBAND_HEARTBEAT 15 * 60
+#endif
+
+struct TelemetryDeadbandFilter {
+    char metric[TELEMETRY_METRIC_NAME_SIZE];
+    float threshold;
+    bool relative;          // The threshold is a fraction of the last recorded value.
+    uint16_t heartbeat;     // Seconds.
+    bool recorded;          // A value has been recorded already.
+    float last;             // Last recorded value.
+    unsigned long lastMillis;
+};
+
+/*
+ * Change-only recording. A value within the threshold of the last recorded one is suppressed,
+ * unless nothing has been recorded for the heartbeat time. So a flat signal still has a value
+ * every heartbeat and a gap in the data means an outage.
+ */
+class TelemetryDeadband {
+    public:
+        // Set the deadband for the metric. The threshold is absolute, or a fraction of the last
+        // recorded value if relative, like 0.05 for 5%. Threshold 0 records changed values only.
+        bool set(const char* metric, float threshold, bool relative, uint16_t heartbeat) {
+            TelemetryDeadbandFilter* filter = find(metric);
+            if (filter == NULL) {
+                if (_count >= TELEMETRY_MAX_DEADBANDS || strlen(metric) >= TELEMETRY_METRIC_NAME_SIZE) {
+                    return false;
+                }
+                filter = &_filters[_count++];
+                strcpy(filter->metric, metric);
+                filter->recorded = false;
+            }
+
+            filter->threshold = threshold;
+            filter->relative = relative;
+            filter->heartbeat = heartbeat;
+            return true;
+        }
+
+        // Check if the value should be recorded. Metrics without deadband are always recorded.
+        bool shouldRecord(const char* metric, float value) {
+            TelemetryDeadbandFilter* filter = find(metric);
+            if (filter == NULL) {
+                return true;
+            }
+
+            if (filter->recorded && millis() - filter->lastMillis < filter->heartbeat * 1000UL) {
+                float threshold = filter->relative ? filter->threshold * fabsf(filter->last) : filter->threshold;
+                if (fabsf(value - filter->last) <= threshold) {
+                    _suppressed++;
+                    return false;
+                }
+            }
+
+            filter->recorded = true;
+            filter->last = value;
+            filter->lastMillis = millis();
+            return true;
+        }
+
+        // Force recording the next value of each metric.
+        void reset() {
+            for (uint8_t i = 0; i < _count; i++) {
+                _filters[i].recorded = false;
+            }
+        }
+
+        uint32_t getSuppressed() {
+            return _suppressed;
+        }
+
+    private:
+        TelemetryDeadbandFilter* find(const char* metric) {
+            for (uint8_t i = 0; i < _count; i++) {
+                if (strcmp(_filters[i].metric, metric) == 0) {
+                    return &_filters[i];
+                }
+            }
+            return NULL;
+        }
+
+        TelemetryDeadbandFilter _filters[TELEMETRY_MAX_DEADBANDS];
+        uint8_t _count = 0;
+        uint32_t _suppressed = 0;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Arduino.h"
+
+// Maximum number of distinct names that can be kept in the telemetry store at the same time.
+#ifndef TELEMETRY_MAX_METRICS
+#define TELEMETRY_MAX_METRICS 32
+#endif
+
+// Maximum length of metric, field and tag set names, including the terminating '\0'.
+#ifndef TELEMETRY_METRIC_NAME_SIZE
+#define TELEMETRY_METRIC_NAME_SIZE 32
+#endif
+
+/*
+ * Table of the names used by the telemetry stores. The samples keep only the name index.
+ */
+class TelemetryNames {
+    public:
+        // Returns the index of the name, adding it to the table if needed. Returns -1 if the
+        // table is full or the name is too long.
+        int16_t intern(const char* name) {
+            for (uint8_t i = 0; i < _count; i++) {
+                if (strcmp(_names[i], name) == 0) {
+                    return i;
+                }
+            }
+
+            if (_count >= TELEMETRY_MAX_METRICS || strlen(name) >= TELEMETRY_METRIC_NAME_SIZE) {
+                return -1;
+            }
+
+            strcpy(_names[_count], name);
+            return _count++;
+        }
+
+        const char* get(uint8_t index) {
+            return _names[index];
+        }
+
+        // Should be called only when no samples refer to the names.
+        void clear() {
+            _count = 0;
+        }
+
+    private:
+        char _names[TELEMETRY_MAX_METRICS][TELEMETRY_METRIC_NAME_SIZE];
+        uint8_t _count = 0;
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Arduino.h"
+
+/*
+ * Source of line protocol data for pushing.
+ *
+ * The data is read with a cursor as whole lines. The data read since the last rewind() is dropped
+ * by commit(), so a failed push can be retried by calling rewind() again.
+ */
+class TelemetrySource {
+    public:
+        // Reset the read cursor to the oldest not committed data.
+        virtual void rewind() = 0;
+
+        // True if there is data after the read cursor.
+        virtual bool available() = 0;
+
+        // Read as many whole lines as possible in the buffer, starting from the read cursor.
+        // Returns the number of bytes written. The buffer is not null terminated.
+        virtual size_t read(char* buffer, size_t size) = 0;
+
+        // Drop the data that was read since the last rewind().
+        virtual void commit() = 0;
+};
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <FS.h>
+#include <LittleFS.h>
+
+#include "Logger.h"
+#include "TelemetrySource.h"
+
+// Directory for the spool segments.
+#ifndef SPOOL_DIR
+#define SPOOL_DIR "/spool"
+#endif
+
+// A new segment is started once the current one reaches that size.
+#ifndef SPOOL_SEGMENT_SIZE
+#define SPOOL_SEGMENT_SIZE 16 * 1024
+#endif
+
+// Maximum number of segments. Once reached, the oldest segment gets dropped.
+#ifndef SPOOL_MAX_SEGMENTS
+#define SPOOL_MAX_SEGMENTS 64
+#endif
+
+#define SPOOL_CURSOR_FILE SPOOL_DIR "/cursor"
+
+/*
+ * Flash backed telemetry spool.
+ *
+ * Line protocol data that can't be pushed is appended to segment files named by sequence number.
+ * The data is read back oldest first. The read cursor is kept in a file, so the data that was
+ * already pushed is not send again after a restart. Fully pushed segments are deleted.
+ */
+class TelemetrySpool : public TelemetrySource {
+    public:
+        TelemetrySpool(Logger* logger, FS* fs = &LittleFS) {
+            _logger = logger;
+            _fs = fs;
+        }
+
+        void begin() {
+            if (!_fs->begin()) {
+                _logger->error(LOG_MODULE_INFLUXDB, "Failed to mount the telemetry spool file system");
+                return;
+            }
+            _fs->mkdir(SPOOL_DIR);
+
+            // Find the oldest and the newest segments.
+            Dir dir = _fs->openDir(SPOOL_DIR);
+            while (dir.next()) {
+                char* end;
+                uint32_t seq = strtoul(dir.fileName().c_str(), &end, 10);
+                if (*end != '\0' || seq == 0) {
+                    continue;
+                }
+                if (_last < _first) {
+                    _first = seq;
+                    _last = seq;
+                    _lastSize = dir.fileSize();
+                } else if (seq < _first) {
+                    _first = seq;
+                } else if (seq > _last) {
+                    _last = seq;
+                    _lastSize = dir.fileSize();
+                }
+            }
+
+            if (!isEmpty() && _lastSize > 0) {
+                // If the last write was interrupted by a reset, the segment ends with partial line.
+                // Don't append to it, otherwise the partial line will corrupt the next one. The new
+                // data will go in a new segment.
+                char path[32];
+                segmentPath(path, _last);
+                File file = _fs->open(path, "r");
+                if (file) {
+                    file.seek(_lastSize - 1);
+                    if (file.read() != '\n') {
+                        _last++;
+                        _lastSize = 0;
+                    }
+                    file.close();
+                }
+            }
+
+            // Restore the cursor. It is valid only if its segment is still the oldest one.
+            File file = _fs->open(SPOOL_CURSOR_FILE, "r");
+            if (file) {
+                uint32_t cursor[2];
+                if (file.read((uint8_t*)cursor, sizeof(cursor)) == sizeof(cursor) && cursor[0] == _first) {
+                    _cursorOffset = cursor[1];
+                }
+                file.close();
+            }
+
+            _ready = true;
+            rewind();
+
+            if (!isEmpty()) {
+                _logger->info(LOG_MODULE_INFLUXDB, "Telemetry spool has %d segments", (int)(_last - _first + 1));
+            }
+        }
+
+        // Move all data from the source to the spool.
+        bool spill(TelemetrySource* source, char* buffer, size_t size) {
+            if (!_ready) {
+                return false;
+            }
+
+            source->rewind();
+            while (source->available()) {
+                size_t dataSize = source->read(buffer, size);
+                if (dataSize == 0) {
+                    break;
+                }
+                if (!write(buffer, dataSize)) {
+                    source->rewind();
+                    return false;
+                }
+                source->commit();
+            }
+            return true;
+        }
+
+        bool isEmpty() {
+            return _last < _first;
+        }
+
+        void rewind() override {
+            _readSeq = _first;
+            _readOffset = _cursorOffset;
+        }
+
+        bool available() override {
+            return !isEmpty() && (_readSeq < _last || _readOffset < _lastSize);
+        }
+
+        size_t read(char* buffer, size_t size) override {
+            while (available()) {
+                char path[32];
+                segmentPath(path, _readSeq);
+                File file = _fs->open(path, "r");
+                if (!file || _readOffset >= file.size()) {
+                    // Missing or fully read segment.
+                    if (file) {
+                        file.close();
+                    }
+                    if (_readSeq == _last) {
+                        return 0;
+                    }
+                    _readSeq++;
+                    _readOffset = 0;
+                    continue;
+                }
+
+                file.seek(_readOffset);
+                size_t dataSize = file.read((uint8_t*)buffer, size);
+                file.close();
+
+                // Return whole lines only.
+                size_t lineEnd = dataSize;
+                while (lineEnd > 0 && buffer[lineEnd - 1] != '\n') {
+                    lineEnd--;
+                }
+
+                if (lineEnd == 0) {
+                    // No line end at all - the line is longer than the buffer or the write was
+                    // interrupted by a reset. Skip the data.
+                    _readOffset += dataSize;
+                    continue;
+                }
+
+                _readOffset += lineEnd;
+                return lineEnd;
+            }
+            return 0;
+        }
+
+        void commit() override {
+            while (!isEmpty() && _first < _readSeq) {
+                removeSegment(_first++);
+            }
+
+            if (!isEmpty() && _readSeq == _last && _readOffset >= _lastSize) {
+                // All data is pushed.
+                removeSegment(_first++);
+                _readOffset = 0;
+                _lastSize = 0;
+            }
+
+            _cursorOffset = _readOffset;
+            _readSeq = _first;
+
+            File file = _fs->open(SPOOL_CURSOR_FILE, "w");
+            if (file) {
+                uint32_t cursor[2] = {_first, _cursorOffset};
+                file.write((uint8_t*)cursor, sizeof(cursor));
+                file.close();
+            }
+        }
+
+    private:
+        bool write(const char* data, size_t size) {
+            if (isEmpty() || _lastSize + size > SPOOL_SEGMENT_SIZE) {
+                if (!isEmpty() && _last - _first + 1 >= SPOOL_MAX_SEGMENTS) {
+                    _logger->warn(LOG_MODULE_INFLUXDB, "Telemetry spool is full, dropping the oldest segment");
+                    removeSegment(_first++);
+                    _cursorOffset = 0;
+                    rewind();
+                }
+                if (isEmpty()) {
+                    _first = _last + 1;
+                }
+                _last++;
+                _lastSize = 0;
+            }
+
+            char path[32];
+            segmentPath(path, _last);
+            File file = _fs->open(path, "a");
+            if (!file) {
+                _logger->error(LOG_MODULE_INFLUXDB, "Failed to open %s", path);
+                return false;
+            }
+
+            size_t written = file.write((const uint8_t*)data, size);
+            if (written != size) {
+                // Drop the partial line, otherwise the next write would join it with its first
+                // line. If that fails, leave it at the end of the segment, where read() skips it.
+                if (!file.truncate(_lastSize)) {
+                    _last++;
+                    _lastSize = 0;
+                }
+                file.close();
+                _logger->error(LOG_MODULE_INFLUXDB, "Failed to write to %s, the file system is full?", path);
+                return false;
+            }
+            file.close();
+            _lastSize += written;
+            return true;
+        }
+
+        void removeSegment(uint32_t seq) {
+            char path[32];
+            segmentPath(path, seq);
+            _fs->remove(path);
+        }
+
+        void segmentPath(char* path, uint32_t seq) {
+            sprintf(path, SPOOL_DIR "/%08lu", (unsigned long)seq);
+        }
+
+        Logger* _logger;
+        FS* _fs;
+        bool _ready = false;
+
+        // Segments from _first to _last exist. _last < _first if the spool is empty.
+        uint32_t _first = 1;
+        uint32_t _last = 0;
+        uint32_t _lastSize = 0;
+
+        // Committed read offset in the _first segment.
+        uint32_t _cursorOffset = 0;
+
+        uint32_t _readSeq = 1;
+        uint32_t _readOffset = 0;
+};
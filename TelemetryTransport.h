@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Arduino.h"
+#include "TelemetrySource.h"
+
+/*
+ * Byte and latency counters of a transport.
+ */
+class TransportStats {
+    public:
+        // Record a send of the specified number of bytes, started at the specified millis().
+        void record(size_t bytes, unsigned long startedAt) {
+            unsigned long latency = millis() - startedAt;
+            _bytes += bytes;
+            _sends++;
+            _latency += latency;
+            _maxLatency = max(_maxLatency, latency);
+        }
+
+        uint32_t getBytes() {
+            return _bytes;
+        }
+
+        uint32_t getSends() {
+            return _sends;
+        }
+
+        // Human readable stats, like 'HTTP 12345 bytes in 10 sends, 120ms avg, 800ms max'.
+        void getStatus(const char* name, char* buffer, size_t size) {
+            snprintf(
+                buffer,
+                size,
+                "%s %lu bytes in %lu sends, %lums avg, %lums max",
+                name,
+                (unsigned long)_bytes,
+                (unsigned long)_sends,
+                _sends > 0 ? _latency / _sends : 0,
+                _maxLatency);
+        }
+
+    private:
+        uint32_t _bytes = 0;
+        uint32_t _sends = 0;
+        unsigned long _latency = 0;
+        unsigned long _maxLatency = 0;
+};
+
+/*
+ * A way to deliver line protocol to InfluxDB.
+ */
+class TelemetryTransport {
+    public:
+        // Send up to limit bytes from the source. The sent data should be committed in the source.
+        virtual bool send(TelemetrySource* source, size_t limit) = 0;
+
+        // The server time of the last successful send, as an HTTP Date header value. Empty if the
+        // transport gets no response.
+        virtual const char* getDate() {
+            return "";
+        }
+
+        TransportStats stats;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+
+#include "Logger.h"
+#include "TelemetryTransport.h"
+
+// Maximum datagram payload. 1472 bytes fit in a 1500 bytes Ethernet frame, but some links have
+// smaller MTU and fragmented datagrams are often dropped.
+#ifndef UDP_TRANSPORT_MTU
+#define UDP_TRANSPORT_MTU 1400
+#endif
+
+/*
+ * Line protocol over UDP, for the InfluxDB UDP listener.
+ *
+ * The data is sent as datagrams of whole lines, up to UDP_TRANSPORT_MTU bytes each. There is no
+ * connection and no response, so a datagram takes a single packet on air. On the other hand there
+ * is no delivery confirmation either - the data is committed once the datagram is sent.
+ *
+ * The timestamps are in seconds, while the UDP listener expects nanoseconds by default and has no
+ * per-request precision. Its configuration must set precision = "s", otherwise the points are
+ * written near 1970.
+ */
+class UdpTransport : public TelemetryTransport {
+    public:
+        // The buffer is used for rendering the datagrams.
+        UdpTransport(Logger* logger, char* buffer, size_t size) {
+            _logger = logger;
+            _buffer = buffer;
+            _size = min(size, (size_t)UDP_TRANSPORT_MTU);
+        }
+
+        void setTarget(IPAddress ip, uint16_t port) {
+            _ip = ip;
+            _port = port;
+        }
+
+        bool send(TelemetrySource* source, size_t limit) override {
+            size_t sent = 0;
+            source->rewind();
+            while (source->available() && sent < limit) {
+                size_t size = source->read(_buffer, _size);
+                if (size == 0) {
+                    break;
+                }
+
+                unsigned long startedAt = millis();
+                if (!_udp.beginPacket(_ip, _port) ||
+                    _udp.write((uint8_t*)_buffer, size) != size ||
+                    !_udp.endPacket()) {
+                    source->rewind();
+                    _logger->warn(LOG_MODULE_INFLUXDB, "Failed to send %u bytes UDP datagram", (unsigned int)size);
+                    return false;
+                }
+                stats.record(size, startedAt);
+
+                source->commit();
+                sent += size;
+            }
+            return true;
+        }
+
+    private:
+        Logger* _logger;
+        WiFiUDP _udp;
+        char* _buffer;
+        size_t _size;
+        IPAddress _ip;
+        uint16_t _port = 0;
+};
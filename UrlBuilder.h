@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Arduino.h"
+
+/*
+ * Request URI built in a fixed buffer, without heap allocations.
+ *
+ * The values are percent-encoded, so names with spaces, quotes or '&' can't break the query. A
+ * constant prefix, like the path with the database, can be built once and kept with mark() - each
+ * request then starts from it with reset().
+ */
+class UrlBuilder {
+    public:
+        UrlBuilder(char* buffer, size_t size) {
+            _buffer = buffer;
+            _size = size;
+            clear();
+        }
+
+        // Drop everything, including the prefix.
+        void clear() {
+            _mark = 0;
+            reset();
+        }
+
+        // Keep the current content as the prefix.
+        void mark() {
+            _mark = _length;
+        }
+
+        // Go back to the prefix.
+        void reset() {
+            _length = _mark;
+            _buffer[_length] = '\0';
+            _overflowed = false;
+        }
+
+        // Append the text as it is. Use for the constant parts, already encoded.
+        UrlBuilder& append(const char* text) {
+            while (*text != '\0') {
+                put(*text++);
+            }
+            return *this;
+        }
+
+        UrlBuilder& append(uint32_t value) {
+            char digits[11];
+            snprintf(digits, sizeof(digits), "%lu", (unsigned long)value);
+            return append(digits);
+        }
+
+        // Append the value percent-encoded. If quote is set, the value is meant to be within such
+        // quotes in an InfluxQL statement - the quote and '\' characters are escaped with '\'.
+        UrlBuilder& appendEncoded(const char* value, char quote='\0') {
+            const char hex[] = "0123456789ABCDEF";
+            while (*value != '\0') {
+                char c = *value++;
+                if (quote != '\0' && (c == quote || c == '\\')) {
+                    append("%5C");
+                }
+                if (isalnum((unsigned char)c) || c == '-' || c == '_' || c == '.' || c == '~') {
+                    put(c);
+                } else {
+                    put('%');
+                    put(hex[(uint8_t)c >> 4]);
+                    put(hex[c & 0x0F]);
+                }
+            }
+            return *this;
+        }
+
+        const char* c_str() {
+            return _buffer;
+        }
+
+        size_t length() {
+            return _length;
+        }
+
+        // Something didn't fit in the buffer, the URI is truncated.
+        bool overflowed() {
+            return _overflowed;
+        }
+
+    private:
+        void put(char c) {
+            if (_length + 1 >= _size) {
+                _overflowed = true;
+                return;
+            }
+            _buffer[_length++] = c;
+            _buffer[_length] = '\0';
+        }
+
+        char* _buffer;
+        size_t _size;
+        size_t _length;
+        size_t _mark;
+        bool _overflowed;
+};
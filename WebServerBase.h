@@ -24,6 +24,7 @@ class WebServerBase {
             server = new ESP8266WebServer(80);
             server->on("/reboot", std::bind(&WebServerBase::handle_reboot, this));
             server->on("/logs", std::bind(&WebServerBase::handle_logs, this));
+            server->on("/logs/levels", std::bind(&WebServerBase::handle_log_levels, this));
             registerHandlers();
 
             httpUpdater = new ESP8266HTTPUpdateServer(true);
@@ -100,12 +101,46 @@ class WebServerBase {
         NetworkSettings* networkSettings = NULL;
 
         void handle_reboot() {
+            logger->warn(LOG_MODULE_SYSTEM, "Restarting on request");
             server->send(200, "text/plain", "Restarting...");
             delay(1000);
             ESP.reset();
         }
 
+        // Stream the logs with chunked encoding, as they are stored, without copying them.
         void handle_logs() {
-            server->send(200, "text/plain", logger->getLogs());
+            server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+            server->send(200, "text/plain", "");
+            logger->streamLogs([this](const char* data, size_t length) {
+                server->sendContent(data, length);
+            });
+            server->sendContent("");
+        }
+
+        // Show the runtime log levels of the modules. Set with the module name as the argument,
+        // like /logs/levels?wifi=debug.
+        void handle_log_levels() {
+            char response[160];
+            size_t length = snprintf(response, sizeof(response), "compiled=%s\n", Logger::getLevelName(LOG_LEVEL));
+            for (uint8_t module = 0; module < LOG_MODULE_COUNT; module++) {
+                const char* name = Logger::getModuleName(module);
+                if (server->hasArg(name)) {
+                    String value = server->arg(name);
+                    for (uint8_t level = LOG_LEVEL_DEBUG; level <= LOG_LEVEL_NONE; level++) {
+                        if (value.equalsIgnoreCase(Logger::getLevelName(level))) {
+                            logger->setLevel(module, level);
+                        }
+                    }
+                }
+                if (length < sizeof(response)) {
+                    length += snprintf(
+                        response + length,
+                        sizeof(response) - length,
+                        "%s=%s\n",
+                        name,
+                        Logger::getLevelName(logger->getLevel(module)));
+                }
+            }
+            server->send(200, "text/plain", response);
         }
 };
@@ -28,7 +28,9 @@ SSID:<br>
 <small><em>WiFi network to connect to</em></small><br><br>
 Password:<br>
 <input type="password" name="password"><br>
-<small><em>WiFi network password</em></small><br>
+<small><em>WiFi network password</em></small><br><br>
+Radio on time:<br>
+<small><em>%s</em></small><br>
 </fieldset>
 )=====";
 
@@ -41,6 +43,23 @@ enum _WiFiState {
 
 #define WIFI_CONNECT_TIMEOUT 10000  // 10 seconds
 
+// Maximum number of modules that use the network through leases.
+#ifndef WIFI_MAX_MODULES
+#define WIFI_MAX_MODULES 4
+#endif
+
+#define WIFI_NO_MODULE 0xFF
+
+struct WiFiModule {
+    const char* name;
+    bool leased;
+    bool scheduled;
+    unsigned long deadline;         // The network is needed at that millis().
+    unsigned long slack;            // Can be used up to that many milliseconds before the deadline.
+    unsigned long leasedAt;
+    unsigned long leaseTime;        // Total time with lease, in milliseconds.
+};
+
 class WiFiManager {
     public:
         WiFiManager(Logger* logger, NetworkSettings* settings, RTCNetworkSettings* rtcSettings=NULL) {
@@ -63,9 +82,10 @@ class WiFiManager {
                 case CONNECTING:
                     if (WiFi.status() == WL_CONNECTED) {
                         if (_logger != NULL) {
-                            _logger->log("Connected in %.1f seconds, IP address is %s",
-                                        (millis() - _lastStateSetAt)/1000.0f,
-                                        WiFi.localIP().toString().c_str());
+                            // Debug, so a connect alone is not a new line for the SyslogSink to ship.
+                            _logger->debug(LOG_MODULE_WIFI, "Connected in %.1f seconds, IP address is %s",
+                                           (millis() - _lastStateSetAt)/1000.0f,
+                                           WiFi.localIP().toString().c_str());
                         }
 
                         if (_rtcSettings != NULL) {
@@ -77,7 +97,7 @@ class WiFiManager {
                     } else if (millis() - _lastStateSetAt > WIFI_CONNECT_TIMEOUT || strlen(_settings->ssid)==0) {
                         if (_rtcSettings != NULL &&_rtcSettings->wifi_channel != 0) {
                             if (_logger != NULL) {
-                                _logger->log("Quick connect failed, retrying with regular one");
+                                _logger->warn(LOG_MODULE_WIFI, "Quick connect failed, retrying with regular one");
                             }
                             _rtcSettings->wifi_channel = 0;
                             ESP.eraseConfig();
@@ -85,7 +105,7 @@ class WiFiManager {
                             break;
                         }
                         if (_logger != NULL) {
-                            _logger->log("Connection failed, going in AP mode");
+                            _logger->warn(LOG_MODULE_WIFI, "Connection failed, going in AP mode");
                         }
 
                         // For setup and debug purposes.
@@ -137,12 +157,118 @@ class WiFiManager {
             return _state == AP;
         }
 
+        // Modules that share the network get a lease while using it. The WiFi is turned off only
+        // once no module holds a lease or is about to need it, so one module can't turn it off
+        // under another. Returns the module id or WIFI_NO_MODULE if there are too many modules.
+        uint8_t registerModule(const char* name) {
+            if (_modulesCount >= WIFI_MAX_MODULES) {
+                return WIFI_NO_MODULE;
+            }
+            WiFiModule* module = &_modules[_modulesCount];
+            memset(module, 0, sizeof(WiFiModule));
+            module->name = name;
+            return _modulesCount++;
+        }
+
+        // Schedule the next network use of the module. It is due at the deadline, or up to slack
+        // milliseconds earlier if the WiFi is on anyway, so the network use of the modules gets
+        // grouped in a single radio window.
+        void schedule(uint8_t id, unsigned long deadline, unsigned long slack) {
+            if (id >= _modulesCount) {
+                return;
+            }
+            _modules[id].scheduled = true;
+            _modules[id].deadline = deadline;
+            _modules[id].slack = slack;
+        }
+
+        // The module doesn't need the network until scheduled again.
+        void unschedule(uint8_t id) {
+            if (id < _modulesCount) {
+                _modules[id].scheduled = false;
+            }
+        }
+
+        // True if the scheduled network use of the module is due.
+        bool isDue(uint8_t id) {
+            if (id >= _modulesCount || !_modules[id].scheduled) {
+                return false;
+            }
+            WiFiModule* module = &_modules[id];
+            long remaining = (long)(module->deadline - millis());
+            return remaining <= 0 || (remaining <= (long)module->slack && _state != DISCONNECTED);
+        }
+
+        // Take a lease, turning the WiFi on if needed. Returns true once connected. Can be called
+        // repeatedly while waiting for the connection.
+        bool acquire(uint8_t id) {
+            if (id < _modulesCount && !_modules[id].leased) {
+                _modules[id].leased = true;
+                _modules[id].leasedAt = millis();
+            }
+            connect();
+            return isConnected();
+        }
+
+        // Release the lease. If the module doesn't need the WiFi to stay on, it is turned off once
+        // no other module holds a lease or is due.
+        void release(uint8_t id, bool disconnectIfUnused=true) {
+            if (id < _modulesCount && _modules[id].leased) {
+                _modules[id].leased = false;
+                _modules[id].leaseTime += millis() - _modules[id].leasedAt;
+            }
+
+            if (!disconnectIfUnused) {
+                return;
+            }
+            for (uint8_t i = 0; i < _modulesCount; i++) {
+                if (_modules[i].leased || isDue(i)) {
+                    return;
+                }
+            }
+            disconnect();
+        }
+
+        // Total radio on time in seconds, including the AP mode.
+        uint32_t getRadioOnTime() {
+            unsigned long radioOnTime = _radioOnTime;
+            if (_state != DISCONNECTED) {
+                radioOnTime += millis() - _lastStateSetAt;
+            }
+            return radioOnTime / 1000;
+        }
+
+        // Total lease time of the module in seconds, including the current lease.
+        uint32_t getLeaseTime(uint8_t id) {
+            if (id >= _modulesCount) {
+                return 0;
+            }
+            unsigned long leaseTime = _modules[id].leaseTime;
+            if (_modules[id].leased) {
+                leaseTime += millis() - _modules[id].leasedAt;
+            }
+            return leaseTime / 1000;
+        }
+
         void get_config_page(char* buffer) {
+            // Like 'total 120s, collector 80s, client 30s'.
+            char radioOnTime[128];
+            size_t length = snprintf(radioOnTime, sizeof(radioOnTime), "total %lus", (unsigned long)getRadioOnTime());
+            for (uint8_t i = 0; i < _modulesCount && length < sizeof(radioOnTime); i++) {
+                length += snprintf(
+                    radioOnTime + length,
+                    sizeof(radioOnTime) - length,
+                    ", %s %lus",
+                    _modules[i].name,
+                    (unsigned long)getLeaseTime(i));
+            }
+
             sprintf_P(
                 buffer,
                 NETWORK_CONFIG_PAGE,
                 _settings->hostname,
-                _settings->ssid);
+                _settings->ssid,
+                radioOnTime);
         }
 
         void parse_config_params(WebServerBase* webServer) {
@@ -156,7 +282,7 @@ class WiFiManager {
             // WiFi.disconnect();
 
             if (_logger != NULL) {
-                _logger->log("Hostname is %s", _settings->hostname);
+                _logger->debug(LOG_MODULE_WIFI, "Hostname is %s", _settings->hostname);
             }
 
             _setState(CONNECTING);
@@ -185,12 +311,19 @@ class WiFiManager {
         }
 
         void _setState(_WiFiState state) {
+            if (_state != DISCONNECTED) {
+                _radioOnTime += millis() - _lastStateSetAt;
+            }
             _state = state;
             _lastStateSetAt = millis();
         }
 
-        _WiFiState _state;
-        unsigned long _lastStateSetAt;
+        _WiFiState _state = DISCONNECTED;
+        unsigned long _lastStateSetAt = 0;
+        unsigned long _radioOnTime = 0;
+
+        WiFiModule _modules[WIFI_MAX_MODULES];
+        uint8_t _modulesCount = 0;
 
         Logger* _logger = NULL;
         NetworkSettings* _settings = NULL;
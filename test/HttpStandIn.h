@@ -0,0 +1,203 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+// Date header of the responses.
+#define HTTP_STAND_IN_DATE "Sat, 08 Dec 2018 07:38:17 GMT"
+
+// Body of the GET responses.
+#define HTTP_STAND_IN_BODY "{\"results\":[{\"statement_id\":0,\"series\":[{\"values\":[[1544254697,21.5]]}]}]}"
+
+/*
+ * Local stand-in for the InfluxDB HTTP API, for the host tests. It runs in a child process, so it
+ * doesn't count in the allocations of the test, and serves one keep-alive connection at a time.
+ *
+ * Each request is answered after the delay. A GET gets HTTP_STAND_IN_BODY, sent slowly - the
+ * headers first, then the body in parts, the delay apart. A POST gets 204 if its whole body was
+ * received, with a Content-Length or chunked, 400 otherwise. After a GET of "/stale" the next
+ * request on the connection is dropped without a response, like by a server that closed the idle
+ * keep-alive connection meanwhile.
+ */
+class HttpStandIn {
+    public:
+        HttpStandIn(unsigned long delay) {
+            _delay = delay;
+            _listener = socket(AF_INET, SOCK_STREAM, 0);
+            int reuse = 1;
+            setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t length = sizeof(address);
+            if (bind(_listener, (sockaddr*)&address, sizeof(address)) != 0 ||
+                listen(_listener, 4) != 0 ||
+                getsockname(_listener, (sockaddr*)&address, &length) != 0) {
+                perror("HTTP stand-in");
+                exit(1);
+            }
+            snprintf(_address, sizeof(_address), "http://127.0.0.1:%u", ntohs(address.sin_port));
+
+            fflush(stdout);
+            _child = fork();
+            if (_child == 0) {
+                serve();
+                _exit(0);
+            }
+            close(_listener);
+        }
+
+        ~HttpStandIn() {
+            kill(_child, SIGKILL);
+            waitpid(_child, NULL, 0);
+        }
+
+        const char* getAddress() {
+            return _address;
+        }
+
+    private:
+        void serve() {
+            while (true) {
+                int connection = accept(_listener, NULL, NULL);
+                if (connection < 0) {
+                    return;
+                }
+                bool drop = false;
+                while (handle(connection, drop)) {
+                }
+                close(connection);
+            }
+        }
+
+        // Answer a request. Returns false once the connection is closed.
+        bool handle(int connection, bool& drop) {
+            char method[8] = "";
+            char path[256] = "";
+            long contentLength = 0;
+            bool chunked = false;
+            char line[512];
+            bool first = true;
+            while (readLine(connection, line, sizeof(line))) {
+                if (line[0] == '\0') {
+                    break;
+                }
+                if (first) {
+                    sscanf(line, "%7s %255s", method, path);
+                    first = false;
+                } else if (strncasecmp(line, "Content-Length:", 15) == 0) {
+                    contentLength = atol(line + 15);
+                } else if (strncasecmp(line, "Transfer-Encoding: chunked", 26) == 0) {
+                    chunked = true;
+                }
+            }
+            if (first) {
+                return false;
+            }
+
+            long received = 0;
+            if (chunked) {
+                // Each chunk is its hex size line, the data and CRLF, up to the empty last chunk.
+                long size;
+                while (readLine(connection, line, sizeof(line)) && (size = strtol(line, NULL, 16)) > 0) {
+                    if (receive(connection, size) != size || !readLine(connection, line, sizeof(line))) {
+                        return false;
+                    }
+                    received += size;
+                }
+                readLine(connection, line, sizeof(line));
+                contentLength = received;
+            } else {
+                received = receive(connection, contentLength);
+            }
+
+            if (drop) {
+                return false;
+            }
+            usleep(_delay * 1000);
+
+            char headers[256];
+            if (strcmp(method, "POST") == 0) {
+                snprintf(headers, sizeof(headers),
+                         "HTTP/1.1 %s\r\nDate: " HTTP_STAND_IN_DATE "\r\n%s\r\n",
+                         received == contentLength && received > 0 ? "204 No Content" : "400 Bad Request",
+                         received == contentLength && received > 0 ? "" : "Content-Length: 0\r\n");
+                return sendAll(connection, headers, strlen(headers));
+            }
+
+            const char* body = HTTP_STAND_IN_BODY;
+            size_t size = strlen(body);
+            snprintf(headers, sizeof(headers),
+                     "HTTP/1.1 200 OK\r\nDate: " HTTP_STAND_IN_DATE "\r\n"
+                     "Content-Type: application/json\r\nContent-Length: %u\r\n\r\n",
+                     (unsigned int)size);
+            if (!sendAll(connection, headers, strlen(headers))) {
+                return false;
+            }
+            size_t part = (size + 3) / 4;
+            for (size_t sent = 0; sent < size; sent += part) {
+                usleep(_delay * 1000 / 4);
+                if (!sendAll(connection, body + sent, std::min(part, size - sent))) {
+                    return false;
+                }
+            }
+            drop = strcmp(path, "/stale") == 0;
+            return true;
+        }
+
+        // Receive up to the size of the body. Returns the received size.
+        static long receive(int connection, long size) {
+            long received = 0;
+            char buffer[1024];
+            while (received < size) {
+                ssize_t part = recv(connection, buffer, std::min(sizeof(buffer), (size_t)(size - received)), 0);
+                if (part <= 0) {
+                    break;
+                }
+                received += part;
+            }
+            return received;
+        }
+
+        static bool readLine(int connection, char* line, size_t size) {
+            size_t length = 0;
+            char c;
+            while (recv(connection, &c, 1, 0) == 1) {
+                if (c == '\n') {
+                    line[length] = '\0';
+                    return true;
+                }
+                if (c != '\r' && length < size - 1) {
+                    line[length++] = c;
+                }
+            }
+            return false;
+        }
+
+        static bool sendAll(int connection, const char* data, size_t size) {
+            while (size > 0) {
+                ssize_t sent = send(connection, data, size, MSG_NOSIGNAL);
+                if (sent <= 0) {
+                    return false;
+                }
+                data += sent;
+                size -= sent;
+            }
+            return true;
+        }
+
+        unsigned long _delay;
+        int _listener;
+        pid_t _child;
+        char _address[32];
+};
@@ -0,0 +1,171 @@
+// Host test of the heap allocations per request. Counts the allocations while the InfluxDB query
+// uri is built with UrlBuilder and sent, and while the telemetry is pushed with HttpTransport to a
+// local HTTP stand-in. Both must take none once the connection is open. Also checks the
+// percent-encoding of the names in the uri.
+//
+// Linked with --wrap for malloc, calloc and realloc, so the C allocations are counted too.
+
+#include <new>
+#include <string>
+
+#include "Logger.h"
+#include "TelemetryBuffer.h"
+#include "UrlBuilder.h"
+#include "HttpTransport.h"
+#include "HttpStandIn.h"
+
+static uint32_t allocations = 0;
+
+extern "C" {
+    void* __real_malloc(size_t size);
+    void* __real_calloc(size_t count, size_t size);
+    void* __real_realloc(void* pointer, size_t size);
+
+    void* __wrap_malloc(size_t size) {
+        allocations++;
+        return __real_malloc(size);
+    }
+
+    void* __wrap_calloc(size_t count, size_t size) {
+        allocations++;
+        return __real_calloc(count, size);
+    }
+
+    void* __wrap_realloc(void* pointer, size_t size) {
+        allocations++;
+        return __real_realloc(pointer, size);
+    }
+}
+
+// The default operator delete frees them.
+void* operator new(size_t size) {
+    allocations++;
+    void* pointer = __real_malloc(size);
+    if (pointer == NULL) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+#define REQUESTS 20
+
+static Logger logger(false);
+static HttpConnection connection(&logger);
+static AsyncHttpRequest request;
+static TelemetryBuffer telemetry("node-1");
+static char pushBuffer[1024];
+static HttpTransport transport(&logger, pushBuffer, sizeof(pushBuffer));
+
+static char uriBuffer[512];
+static UrlBuilder uri(uriBuffer, sizeof(uriBuffer));
+
+// The query statement, built the same way as by InfluxDBClient.
+static void buildQuery(const char* metric, const char* src, uint16_t notOlderThan) {
+    uri.reset();
+    uri.append("SELECT+last%28%22value%22%29+FROM+%22").appendEncoded(metric, '"');
+    uri.append("%22+WHERE+time+%3E%3D+now%28%29+-+").append(notOlderThan).append("m+");
+    uri.append("AND+%22src%22%3D%27").appendEncoded(src, '\'').append("%27");
+}
+
+static bool checkQuery(const char* address) {
+    uri.clear();
+    uri.append("/query?db=").appendEncoded("home & garden").append("&epoch=s&q=");
+    uri.mark();
+
+    buildQuery("temp \"in\"", "o'brien/1", 5);
+    const char* expected =
+        "/query?db=home%20%26%20garden&epoch=s&q="
+        "SELECT+last%28%22value%22%29+FROM+%22temp%20%5C%22in%5C%22%22+WHERE+time+%3E%3D+now%28%29+-+5m+"
+        "AND+%22src%22%3D%27o%5C%27brien%2F1%27";
+    if (strcmp(uri.c_str(), expected) != 0) {
+        printf("Unexpected query uri:\n  expected: %s\n  actual:   %s\n", expected, uri.c_str());
+        return false;
+    }
+
+    // The first request opens the connection.
+    uint32_t before = 0;
+    for (uint8_t i = 0; i <= REQUESTS; i++) {
+        if (i == 1) {
+            before = allocations;
+        }
+        buildQuery("temperature", "node-1", 5 + i);
+        if (!request.start(address, "GET", uri.c_str())) {
+            printf("Query failed to start\n");
+            return false;
+        }
+        request.complete();
+        bool success = request.getStatusCode() == 200;
+        request.end(request.getBody().skip() && success);
+        if (!success) {
+            printf("Query failed with HTTP %d\n", request.getStatusCode());
+            return false;
+        }
+    }
+    uint32_t used = allocations - before;
+    printf("Query: %lu allocations in %d requests\n", (unsigned long)used, REQUESTS);
+    return used == 0;
+}
+
+static bool push(uint8_t samples) {
+    for (uint8_t i = 0; i < samples; i++) {
+        telemetry.append("temperature", 21.5f + i / 10.0f, 1, 1700000000 + i * 10);
+    }
+    return transport.send(&telemetry, SIZE_MAX) && telemetry.isEmpty();
+}
+
+static bool checkPush(const char* address, bool chunked) {
+    transport.setChunked(chunked, false);
+    uint32_t before = 0;
+    for (uint8_t i = 0; i <= REQUESTS; i++) {
+        if (i == 1) {
+            before = allocations;
+        }
+        if (!push(50)) {
+            printf("Push failed\n");
+            return false;
+        }
+    }
+    uint32_t used = allocations - before;
+    printf("%s push: %lu allocations in %d requests, %lu bytes pushed\n",
+           chunked ? "Chunked" : "Batched", (unsigned long)used, REQUESTS, (unsigned long)transport.stats.getBytes());
+    return used == 0;
+}
+
+// Make sure the allocations are counted at all.
+static bool checkCounters() {
+    uint32_t before = allocations;
+    free(malloc(16));
+    delete new std::string(64, 'a');
+    return allocations - before >= 2;
+}
+
+int main() {
+    if (!checkCounters()) {
+        printf("The allocations aren't counted\n");
+        return 1;
+    }
+    HttpStandIn server(0);
+    connection.begin();
+    request.begin(&connection);
+    transport.begin(&connection, &request);
+    transport.setTarget(server.getAddress(), "home & garden");
+
+    bool success = checkQuery(server.getAddress()) &&
+        checkPush(server.getAddress(), false) &&
+        checkPush(server.getAddress(), true);
+    printf(success ? "No allocations per request\n" : "Allocations per request FAILED\n");
+    return success ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+// Host test of AsyncHttpRequest against a local HTTP stand-in that answers slowly. The loop keeps
+// running while the request waits for the server, and no poll() call takes much longer than
+// ASYNC_HTTP_POLL_TIME. Also checks the keep-alive reuse and the retry on a stale connection.
+
+#include <chrono>
+#include <string>
+
+#include "Logger.h"
+#include "HttpConnection.h"
+#include "AsyncHttpRequest.h"
+#include "HttpStandIn.h"
+
+// How long the stand-in waits before the response, in milliseconds.
+#define SERVER_DELAY 200
+
+// Allowed poll() time above ASYNC_HTTP_POLL_TIME, for the scheduling of the host.
+#define POLL_TIME_MARGIN 5
+
+static Logger logger(false);
+static HttpConnection connection(&logger);
+static AsyncHttpRequest request;
+
+// Run the request to the end like a loop() would, with other work between the polls. Returns the
+// time it took, in milliseconds.
+static unsigned long run(const char* address, const char* method, const char* uri, const char* body, size_t size) {
+    uint32_t loops = 0;
+    double maxPoll = 0;
+    unsigned long startedAt = millis();
+    if (!request.start(address, method, uri, body, size)) {
+        printf("%s %s: can't start, status %d\n", method, uri, request.getStatusCode());
+        return 0;
+    }
+    while (true) {
+        auto pollStartedAt = std::chrono::steady_clock::now();
+        bool done = request.poll();
+        maxPoll = max(maxPoll, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pollStartedAt).count());
+        if (done) {
+            break;
+        }
+        loops++;
+        usleep(100);
+    }
+    unsigned long duration = millis() - startedAt;
+    printf("%s %s: HTTP %d in %lu ms, %lu loops meanwhile, longest poll() %.2f ms\n",
+           method, uri, request.getStatusCode(), duration, (unsigned long)loops, maxPoll);
+    if (maxPoll > ASYNC_HTTP_POLL_TIME + POLL_TIME_MARGIN) {
+        printf("The poll() took too long\n");
+        return 0;
+    }
+    return duration;
+}
+
+static bool checkSlowGet(const char* address) {
+    unsigned long duration = run(address, "GET", "/slow", NULL, 0);
+    if (duration < SERVER_DELAY || request.getStatusCode() != 200) {
+        return false;
+    }
+
+    std::string body;
+    HttpBodyStream stream = request.getBody();
+    int c;
+    while ((c = stream.read()) >= 0) {
+        body += (char)c;
+    }
+    request.end(stream.skip());
+    if (body != HTTP_STAND_IN_BODY || strcmp(request.getDate(), HTTP_STAND_IN_DATE) != 0) {
+        printf("Unexpected response: '%s', date '%s'\n", body.c_str(), request.getDate());
+        return false;
+    }
+    return true;
+}
+
+static bool checkPost(const char* address) {
+    char body[3000];
+    for (size_t i = 0; i < sizeof(body); i++) {
+        body[i] = i % 64 == 63 ? '\n' : 'a' + i % 26;
+    }
+    if (run(address, "POST", "/write?db=test", body, sizeof(body)) == 0 || request.getStatusCode() != 204) {
+        return false;
+    }
+    request.end(true);
+    if (connection.getReuses() != 1) {
+        printf("The keep-alive connection wasn't reused, %lu reuses\n", (unsigned long)connection.getReuses());
+        return false;
+    }
+    return true;
+}
+
+// The stand-in drops the request after "/stale" - it is sent again on a new connection.
+static bool checkStaleRetry(const char* address) {
+    if (run(address, "GET", "/stale", NULL, 0) == 0 || request.getStatusCode() != 200) {
+        return false;
+    }
+    request.end(request.getBody().skip());
+    if (run(address, "GET", "/slow", NULL, 0) == 0 || request.getStatusCode() != 200) {
+        return false;
+    }
+    request.end(request.getBody().skip());
+
+    char requestStatus[96];
+    char connectionStatus[96];
+    request.getStatus(requestStatus, sizeof(requestStatus));
+    connection.getStatus(connectionStatus, sizeof(connectionStatus));
+    printf("Request: %s\nConnection: %s\n", requestStatus, connectionStatus);
+    if (strstr(requestStatus, " 1 retried") == NULL || strstr(connectionStatus, " 1 stale") == NULL) {
+        printf("The stale connection wasn't retried\n");
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    HttpStandIn server(SERVER_DELAY);
+    connection.begin();
+    request.begin(&connection);
+
+    bool success = checkSlowGet(server.getAddress()) &&
+        checkPost(server.getAddress()) &&
+        checkStaleRetry(server.getAddress());
+    printf(success ? "Async requests OK\n" : "Async requests FAILED\n");
+    return success ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+// Host test of FastFormat::formatFloat(). Checks that the output is identical to
+// snprintf("%.*f") over a sweep of values and precisions, then compares their speed.
+//
+// The host printf rounds the exact binary value, to nearest with ties to even, the same as the
+// newlib printf on the ESP8266. The speed ratio on the host only hints at the one on the device,
+// where printf goes through soft-float.
+
+#include <chrono>
+#include <math.h>
+
+#include "FastFormat.h"
+
+static uint32_t checked = 0;
+static uint32_t mismatches = 0;
+
+static void check(float value, uint8_t precision) {
+    char expected[64];
+    char actual[64];
+    snprintf(expected, sizeof(expected), "%.*f", precision, value);
+    size_t length = FastFormat::formatFloat(actual, sizeof(actual) - 1, value, precision);
+    actual[length] = '\0';
+
+    checked++;
+    if (strcmp(expected, actual) != 0) {
+        if (mismatches++ < 10) {
+            printf("MISMATCH %.9g with precision %u: expected '%s', got '%s'\n",
+                   value, precision, expected, actual);
+        }
+    }
+}
+
+static void checkBits(uint32_t bits, uint8_t precision) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    check(value, precision);
+}
+
+static void sweep() {
+    // Bit patterns across the whole float range, all precisions. The stride is odd, so the low
+    // mantissa bits vary too.
+    for (uint64_t bits = 0; bits <= 0xFFFFFFFF; bits += 4099) {
+        for (uint8_t precision = 0; precision <= 9; precision++) {
+            checkBits(bits, precision);
+        }
+    }
+
+    // Decimal values, like the sensor readings, where the rounding ties are.
+    for (int32_t i = -1000000; i <= 1000000; i++) {
+        for (uint8_t precision = 0; precision <= 3; precision++) {
+            check(i / 100.0f, precision);
+        }
+    }
+
+    // Exact halves, rounded to even.
+    for (int32_t i = -4096; i <= 4096; i++) {
+        for (uint8_t precision = 0; precision <= 3; precision++) {
+            check(i / 8.0f, precision);
+        }
+    }
+
+    const float special[] = {
+        0.0f, -0.0f, 1e-45f, -1e-45f, 1.17549435e-38f, 1e-30f, 0.5f, -0.5f, 1.0f,
+        8589934591.0f, 8589934592.0f, 1e10f, 3.4028235e38f, -3.4028235e38f,
+        INFINITY, -INFINITY, NAN
+    };
+    for (float value : special) {
+        for (uint8_t precision = 0; precision <= 12; precision++) {
+            check(value, precision);
+        }
+    }
+
+    // Boundaries of the exponents.
+    for (uint32_t exponent = 0; exponent < 0xFF; exponent++) {
+        for (uint32_t mantissa : {0x000000u, 0x000001u, 0x400000u, 0x7FFFFFu}) {
+            for (uint32_t sign : {0u, 0x80000000u}) {
+                for (uint8_t precision = 0; precision <= 9; precision++) {
+                    checkBits(sign | exponent << 23 | mantissa, precision);
+                }
+            }
+        }
+    }
+}
+
+// Typical readings, like temperature, humidity and voltage.
+static float readings[1024];
+
+template<typename Format>
+static double measure(Format format) {
+    char buffer[64];
+    size_t total = 0;
+    const uint32_t rounds = 1000;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < rounds; round++) {
+        for (uint32_t i = 0; i < sizeof(readings) / sizeof(readings[0]); i++) {
+            total += format(buffer, sizeof(buffer), readings[i], 1 + i % 3);
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    if (total == 0) {
+        printf("Nothing formatted\n");
+    }
+    return std::chrono::duration<double, std::nano>(elapsed).count() /
+        (rounds * (sizeof(readings) / sizeof(readings[0])));
+}
+
+static void benchmark() {
+    for (uint32_t i = 0; i < sizeof(readings) / sizeof(readings[0]); i++) {
+        readings[i] = -40.0f + (i * 7919 % 16000) / 100.0f;
+    }
+
+    double printfTime = measure([](char* buffer, size_t size, float value, uint8_t precision) {
+        return (size_t)snprintf(buffer, size, "%.*f", precision, value);
+    });
+    double fastTime = measure([](char* buffer, size_t size, float value, uint8_t precision) {
+        return FastFormat::formatFloat(buffer, size, value, precision);
+    });
+    printf("snprintf: %.1f ns, FastFormat: %.1f ns per value, %.1fx faster\n",
+           printfTime, fastTime, printfTime / fastTime);
+}
+
+int main() {
+    sweep();
+    printf("%lu values checked, %lu mismatches\n", (unsigned long)checked, (unsigned long)mismatches);
+    benchmark();
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+// Minimal host stand-in for the ESP8266 Arduino core, just enough for the headers under test.
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+
+using std::min;
+using std::max;
+
+// The newlib string function, missing in the older glibc.
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+inline size_t strlcpy(char* destination, const char* source, size_t size) {
+    size_t length = strlen(source);
+    if (size > 0) {
+        size_t copied = min(length, size - 1);
+        memcpy(destination, source, copied);
+        destination[copied] = '\0';
+    }
+    return length;
+}
+#endif
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define pgm_read_dword(address) (*(const uint32_t*)(address))
+
+// The time returned by millis(). It follows the real clock, unless a test fixes it for a
+// repeatable output.
+inline bool hostMillisFixed = false;
+inline unsigned long hostMillis = 0;
+
+inline unsigned long millis() {
+    if (hostMillisFixed) {
+        return hostMillis;
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void delay(unsigned long ms) {
+    usleep(ms * 1000);
+}
+
+inline void yield() {
+}
+
+class String {
+    public:
+        String(const char* value = "") : _value(value) {
+        }
+
+        String& operator=(const char* value) {
+            _value = value;
+            return *this;
+        }
+
+        String& operator+=(const char* value) {
+            _value += value;
+            return *this;
+        }
+
+        const char* c_str() const {
+            return _value.c_str();
+        }
+
+    private:
+        std::string _value;
+};
+
+class Print {
+    public:
+        virtual ~Print() {
+        }
+
+        virtual size_t write(uint8_t data) = 0;
+
+        virtual size_t write(const uint8_t* buffer, size_t size) {
+            size_t written = 0;
+            while (written < size && write(buffer[written]) == 1) {
+                written++;
+            }
+            return written;
+        }
+
+        size_t print(const char* text) {
+            return write((const uint8_t*)text, strlen(text));
+        }
+
+        size_t println(const char* text) {
+            return print(text) + print("\r\n");
+        }
+};
+
+class Stream : public Print {
+    public:
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+
+        void setTimeout(unsigned long timeout) {
+            _timeout = timeout;
+        }
+
+        size_t readBytesUntil(char terminator, char* buffer, size_t size) {
+            size_t length = 0;
+            while (length < size) {
+                int c = timedRead();
+                if (c < 0 || c == terminator) {
+                    break;
+                }
+                buffer[length++] = c;
+            }
+            return length;
+        }
+
+    protected:
+        // Wait up to the timeout for a byte.
+        int timedRead() {
+            unsigned long startedAt = millis();
+            do {
+                int c = read();
+                if (c >= 0) {
+                    return c;
+                }
+                yield();
+            } while (millis() - startedAt < _timeout);
+            return -1;
+        }
+
+        unsigned long _timeout = 1000;
+};
+
+class HardwareSerial : public Print {
+    public:
+        size_t write(uint8_t data) override {
+            return fwrite(&data, 1, 1, stdout);
+        }
+};
+
+inline HardwareSerial Serial;
+
+class EspClass {
+    public:
+        String getResetReason() {
+            return String("Power On");
+        }
+
+        bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size) {
+            memcpy(data, _rtc + offset * 4, size);
+            return true;
+        }
+
+        bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size) {
+            memcpy(_rtc + offset * 4, data, size);
+            return true;
+        }
+
+    private:
+        uint8_t _rtc[512] = {};
+};
+
+inline EspClass ESP;
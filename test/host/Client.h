@@ -0,0 +1,6 @@
+#pragma once
+
+#include "Arduino.h"
+
+class Client : public Stream {
+};
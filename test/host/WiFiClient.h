@@ -0,0 +1,151 @@
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "Arduino.h"
+#include "Client.h"
+
+// IPv4 address, kept in the network byte order like on the ESP8266.
+class IPAddress {
+    public:
+        IPAddress(uint32_t address = 0) {
+            _address = address;
+        }
+
+        IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+            uint8_t bytes[] = {a, b, c, d};
+            memcpy(&_address, bytes, sizeof(_address));
+        }
+
+        operator uint32_t() const {
+            return _address;
+        }
+
+    private:
+        uint32_t _address;
+};
+
+/*
+ * TCP client over a POSIX socket. Like the lwIP one, the received data is buffered and the
+ * reads and writes don't wait, except the connect. No heap allocations.
+ */
+class WiFiClient : public Client {
+    public:
+        ~WiFiClient() {
+            stop();
+        }
+
+        int connect(IPAddress ip, uint16_t port) {
+            stop();
+            _socket = socket(AF_INET, SOCK_STREAM, 0);
+            if (_socket < 0) {
+                return 0;
+            }
+            sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(port);
+            address.sin_addr.s_addr = ip;
+            if (::connect(_socket, (sockaddr*)&address, sizeof(address)) != 0) {
+                stop();
+                return 0;
+            }
+            int noDelay = 1;
+            setsockopt(_socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            fcntl(_socket, F_SETFL, O_NONBLOCK);
+            _closed = false;
+            return 1;
+        }
+
+        // Open, or closed by the peer with some data left to read.
+        uint8_t connected() {
+            receive();
+            return _socket >= 0 && (!_closed || _length > 0);
+        }
+
+        void stop() {
+            if (_socket >= 0) {
+                close(_socket);
+            }
+            _socket = -1;
+            _start = 0;
+            _length = 0;
+            _closed = true;
+        }
+
+        int available() override {
+            receive();
+            return _length;
+        }
+
+        int read() override {
+            if (available() == 0) {
+                return -1;
+            }
+            _length--;
+            return _buffer[_start++];
+        }
+
+        int peek() override {
+            return available() > 0 ? _buffer[_start] : -1;
+        }
+
+        size_t write(uint8_t data) override {
+            return write(&data, 1);
+        }
+
+        // Waits until everything is sent, like the ESP8266 client with the default timeout.
+        size_t write(const uint8_t* buffer, size_t size) override {
+            size_t written = 0;
+            while (_socket >= 0 && written < size) {
+                ssize_t sent = send(_socket, buffer + written, size - written, MSG_NOSIGNAL);
+                if (sent > 0) {
+                    written += sent;
+                } else if (sent < 0 && errno == EAGAIN) {
+                    pollfd fd = {_socket, POLLOUT, 0};
+                    if (poll(&fd, 1, _timeout) <= 0) {
+                        break;
+                    }
+                } else {
+                    break;
+                }
+            }
+            return written;
+        }
+
+        int availableForWrite() {
+            pollfd fd = {_socket, POLLOUT, 0};
+            return _socket >= 0 && poll(&fd, 1, 0) > 0 && (fd.revents & POLLOUT) ? 1460 : 0;
+        }
+
+    private:
+        // Move the received data to the buffer.
+        void receive() {
+            if (_socket < 0 || _closed) {
+                return;
+            }
+            if (_start > 0) {
+                memmove(_buffer, _buffer + _start, _length);
+                _start = 0;
+            }
+            if (_length == sizeof(_buffer)) {
+                return;
+            }
+            ssize_t received = recv(_socket, _buffer + _length, sizeof(_buffer) - _length, 0);
+            if (received > 0) {
+                _length += received;
+            } else if (received == 0 || errno != EAGAIN) {
+                _closed = true;
+            }
+        }
+
+        int _socket = -1;
+        bool _closed = true;
+        uint8_t _buffer[4096];
+        size_t _start = 0;
+        size_t _length = 0;
+};
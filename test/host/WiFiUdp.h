@@ -0,0 +1,53 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+// UDP sender over a POSIX socket. The packet is built in a fixed buffer.
+class WiFiUDP : public Print {
+    public:
+        ~WiFiUDP() {
+            if (_socket >= 0) {
+                close(_socket);
+            }
+        }
+
+        int beginPacket(IPAddress ip, uint16_t port) {
+            if (_socket < 0) {
+                _socket = socket(AF_INET, SOCK_DGRAM, 0);
+            }
+            _ip = ip;
+            _port = port;
+            _length = 0;
+            return _socket >= 0 ? 1 : 0;
+        }
+
+        size_t write(uint8_t data) override {
+            return write(&data, 1);
+        }
+
+        size_t write(const uint8_t* buffer, size_t size) override {
+            size = min(size, sizeof(_packet) - _length);
+            memcpy(_packet + _length, buffer, size);
+            _length += size;
+            return size;
+        }
+
+        int endPacket() {
+            sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(_port);
+            address.sin_addr.s_addr = _ip;
+            return sendto(_socket, _packet, _length, 0, (sockaddr*)&address, sizeof(address)) == (ssize_t)_length ? 1 : 0;
+        }
+
+    private:
+        int _socket = -1;
+        IPAddress _ip;
+        uint16_t _port = 0;
+        uint8_t _packet[1472];
+        size_t _length = 0;
+};
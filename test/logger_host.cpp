@@ -0,0 +1,123 @@
+// Host test of the Logger, built once in the text mode and once with LOG_BINARY.
+//
+// 'logger_host lines' logs a set of typical messages and prints the lines as read back. In the
+// binary mode the time prefix is left out, so the output of both builds must be identical - the
+// Makefile compares them. Without arguments it measures the cost of a log() call and of reading
+// the lines back - the binary mode moves the formatting from the first to the second.
+
+#include <chrono>
+
+#include "Logger.h"
+
+static Logger logger(false);
+static uint32_t position = 0;
+
+// Print the lines logged since the last call.
+static void printLines() {
+    logger.readLines(position, [](const char* line, size_t length) {
+#ifdef LOG_BINARY
+        const char* text = strchr(line, ' ') + 1;
+        length -= text - line;
+        line = text;
+#endif
+        printf("%.*s\n", (int)length, line);
+        return true;
+    });
+}
+
+static void lines() {
+    logger.begin();
+    printLines();
+
+    hostMillis = 1234;
+    logger.info(LOG_MODULE_WIFI, "Connected to %s, IP %s, RSSI %d", "home", "192.168.0.17", -67);
+    printLines();
+    logger.warn(LOG_MODULE_INFLUXDB, "Push failed with HTTP %d", 500);
+    printLines();
+    logger.info(LOG_MODULE_INFLUXDB, "Pushed %u bytes gzipped to %u (%.1fx)", 12345u, 2345u, 5.26f);
+    printLines();
+    logger.error(LOG_MODULE_SYSTEM, "Free heap %lu, max block %u", 23456ul, 4096u);
+    printLines();
+    logger.info(LOG_MODULE_RS485, "Read %zu registers from %d at %04x", (size_t)12, 3, 0x1f);
+    printLines();
+    logger.info(LOG_MODULE_SETTINGS, "%-8s|%8s|%5.2f|%e|%g|%c|100%%", "left", "right", 3.14159, 1234.5, 0.0001, 'x');
+    printLines();
+    logger.log("%lld ms, %llu bytes, %ld offset", -123456789012ll, 123456789012ull, -5l);
+    printLines();
+
+    hostMillis = 61001;
+    char message[] = "Not a format %d, logged as is";
+    logger.log(message);
+    printLines();
+    // A message that is not a literal, as long as a text mode line can be.
+    char longMessage[128];
+    for (size_t i = 0; i < sizeof(longMessage) - 1; i++) {
+        longMessage[i] = 'a' + i % 26;
+    }
+    longMessage[sizeof(longMessage) - 1] = '\0';
+    logger.log(longMessage);
+    printLines();
+
+    // Below the runtime level, then enabled.
+    logger.debug(LOG_MODULE_WIFI, "Scan found %d networks", 7);
+    logger.setLevel(LOG_MODULE_WIFI, LOG_LEVEL_DEBUG);
+    logger.debug(LOG_MODULE_WIFI, "Scan found %d networks", 8);
+    printLines();
+
+    // The repeated message is logged once.
+    logger.warn(LOG_MODULE_WIFI, "Lost connection, reason %d", 8);
+    logger.warn(LOG_MODULE_WIFI, "Lost connection, reason %d", 8);
+    printLines();
+
+    // Enough messages to wrap the ring, each read right after it is logged.
+    for (int i = 0; i < 100; i++) {
+        hostMillis += 997;
+        logger.info(LOG_MODULE_INFLUXDB, "Collected %d samples, %.2f V, %s", i, 3.3 + i / 100.0, i % 2 ? "odd" : "even");
+        printLines();
+    }
+}
+
+template<typename Action>
+static double measure(uint32_t count, Action action) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; i++) {
+        action(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / count;
+}
+
+static void benchmark() {
+    const uint32_t count = 1000000;
+    double logTime = measure(count, [](uint32_t i) {
+        hostMillis = i;
+        logger.info(LOG_MODULE_INFLUXDB, "Pushed %u bytes in %lu ms (%.1f kB/s)", i, (unsigned long)(i % 500), i / 1000.0);
+    });
+
+    // Read all lines kept in the ring, from the oldest one.
+    uint32_t lines = 0;
+    double readTime = measure(count / 100, [&lines](uint32_t i) {
+        uint32_t from = 0;
+        logger.readLines(from, [&lines](const char* line, size_t length) {
+            lines++;
+            return true;
+        });
+    });
+
+#ifdef LOG_BINARY
+    const char* mode = "binary";
+#else
+    const char* mode = "text";
+#endif
+    printf("%s mode: %.1f ns per log(), %.1f ns per line read\n", mode, logTime, readTime * (count / 100) / lines);
+}
+
+int main(int argc, char** argv) {
+    hostMillisFixed = true;
+    if (argc > 1 && strcmp(argv[1], "lines") == 0) {
+        lines();
+    } else {
+        benchmark();
+    }
+    return 0;
+}
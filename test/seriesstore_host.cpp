@@ -0,0 +1,230 @@
+// Host round-trip test of SeriesStore. A day of realistic sensor data is encoded, decoded back
+// to line protocol and compared with the lines rendered by snprintf() from the original samples.
+// Reports the memory taken per sample, compared with TelemetryBuffer and the line protocol.
+
+#include <math.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "SeriesStore.h"
+
+#define COLLECT_INTERVAL 10
+#define SAMPLES 8640
+
+// The expected lines of each series, in the order the store creates them.
+static std::vector<std::string> seriesKeys;
+static std::map<std::string, std::string> expectedLines;
+static size_t lineProtocolSize = 0;
+static uint32_t samples = 0;
+
+static uint32_t seed = 1;
+
+// Deterministic pseudo random number in [0, 1).
+static float nextRandom() {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) / 16777216.0f;
+}
+
+static void expect(const char* key, const char* line) {
+    if (expectedLines.find(key) == expectedLines.end()) {
+        seriesKeys.push_back(key);
+    }
+    expectedLines[key] += line;
+    lineProtocolSize += strlen(line);
+    samples++;
+}
+
+static bool append(SeriesStore* store, const char* metric, float value, uint8_t precision, uint32_t timestamp) {
+    if (!store->append(metric, value, precision, timestamp)) {
+        return false;
+    }
+
+    char key[64];
+    char line[128];
+    snprintf(key, sizeof(key), "%s %u %d", metric, precision, timestamp > 0);
+    if (timestamp > 0) {
+        snprintf(line, sizeof(line), "%s,src=host value=%.*f %lu\n", metric, precision, value, (unsigned long)timestamp);
+    } else {
+        snprintf(line, sizeof(line), "%s,src=host value=%.*f\n", metric, precision, value);
+    }
+    expect(key, line);
+    return true;
+}
+
+static bool appendPoint(SeriesStore* store, const char* measurement, const char* tags,
+                        TelemetryField* fields, uint8_t count, uint32_t timestamp) {
+    if (!store->appendPoint(measurement, tags, fields, count, timestamp)) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        char key[96];
+        char line[128];
+        snprintf(key, sizeof(key), "%s,%s %s %u 1", measurement, tags, fields[i].name, fields[i].precision);
+        snprintf(line, sizeof(line), "%s,src=host,%s %s=%.*f %lu\n",
+                 measurement, tags, fields[i].name, fields[i].precision, fields[i].value, (unsigned long)timestamp);
+        expect(key, line);
+    }
+    return true;
+}
+
+// Collect a sample of each metric every COLLECT_INTERVAL seconds, with an occasional late
+// collect and a WiFi outage, until the store is full or a day is collected.
+static uint32_t collect(SeriesStore* store) {
+    uint32_t timestamp = 1700000000;
+    float temperature = 21.5f;
+    float humidity = 45.0f;
+    float pressure = 1013.25f;
+    float battery = 4.15f;
+    float kitchen = 23.0f;
+
+    uint32_t i;
+    for (i = 0; i < SAMPLES; i++) {
+        timestamp += COLLECT_INTERVAL;
+        if (nextRandom() < 0.02f) {
+            timestamp += 1;
+        }
+        if (i == SAMPLES / 2) {
+            timestamp += 3600;
+        }
+
+        // Sensors with a resolution, slowly drifting.
+        if (nextRandom() < 0.1f) {
+            temperature += nextRandom() < 0.5f ? -0.1f : 0.1f;
+        }
+        if (nextRandom() < 0.05f) {
+            humidity += nextRandom() < 0.5f ? -1.0f : 1.0f;
+        }
+        if (nextRandom() < 0.01f) {
+            battery -= 0.01f;
+        }
+        // Raw value with noise in every sample.
+        pressure += (nextRandom() - 0.5f) * 0.02f;
+        kitchen = roundf((23.0f + 2.0f * sinf(i / 500.0f)) * 10.0f) / 10.0f;
+
+        TelemetryField fields[] = {
+            {"temperature", kitchen, 1},
+            {"humidity", roundf(humidity + 5.0f), 0}
+        };
+        if (!append(store, "temperature", roundf(temperature * 10.0f) / 10.0f, 1, timestamp) ||
+            !append(store, "humidity", humidity, 0, timestamp) ||
+            !append(store, "pressure", pressure, 6, timestamp) ||
+            !appendPoint(store, "room", "name=kitchen", fields, 2, timestamp)) {
+            break;
+        }
+        // Rare samples, some without timestamp.
+        if (i % 360 == 0 && !append(store, "battery", battery, 2, i % 720 == 0 ? timestamp : 0)) {
+            break;
+        }
+    }
+    return i;
+}
+
+// Read the whole store with the buffer size. Commit after each read if requested.
+static std::string drain(SeriesStore* store, size_t bufferSize, bool commit) {
+    std::string text;
+    char buffer[1024];
+    store->rewind();
+    while (store->available()) {
+        size_t size = store->read(buffer, bufferSize);
+        if (size == 0) {
+            break;
+        }
+        text.append(buffer, size);
+        if (commit) {
+            store->commit();
+        }
+    }
+    return text;
+}
+
+static bool compare(const char* name, const std::string& actual, const std::string& expected) {
+    if (actual == expected) {
+        return true;
+    }
+
+    size_t position = 0;
+    while (position < actual.size() && position < expected.size() && actual[position] == expected[position]) {
+        position++;
+    }
+    size_t lineStart = expected.rfind('\n', position);
+    lineStart = lineStart == std::string::npos ? 0 : lineStart + 1;
+    printf("%s: MISMATCH at byte %lu\n  expected: %s\n  actual:   %s\n",
+           name,
+           (unsigned long)position,
+           expected.substr(lineStart, expected.find('\n', lineStart) - lineStart).c_str(),
+           actual.substr(lineStart, actual.find('\n', lineStart) - lineStart).c_str());
+    return false;
+}
+
+// Too big for the stack.
+static SeriesStore seriesStore("host");
+
+// A point that fails on its last field must not leave the series of the other fields behind.
+static bool checkFailedPoint(SeriesStore* store) {
+    store->clear();
+    // The names table is full after these, the measurement and the first field.
+    for (int i = 0; i < TELEMETRY_MAX_METRICS - 2; i++) {
+        char metric[16];
+        snprintf(metric, sizeof(metric), "metric%d", i);
+        store->append(metric, i, 0, 1700000000);
+    }
+    uint16_t used = store->size();
+
+    TelemetryField fields[] = {
+        {"first", 1.0f, 0},
+        {"second", 2.0f, 0}
+    };
+    if (store->appendPoint("point", NULL, fields, 2, 1700000000)) {
+        printf("The point with too many names was appended\n");
+        return false;
+    }
+    if (store->size() != used) {
+        printf("The failed point left %u blocks behind\n", store->size() - used);
+        return false;
+    }
+    store->clear();
+    printf("Failed point rolled back\n");
+    return true;
+}
+
+int main() {
+    SeriesStore* store = &seriesStore;
+    uint32_t collects = collect(store);
+
+    std::string expected;
+    for (const std::string& key : seriesKeys) {
+        expected += expectedLines[key];
+    }
+
+    size_t storeSize = store->size() * sizeof(SeriesBlock);
+    printf("%lu collects, %lu samples in %lu series, %lu of %lu blocks used\n",
+           (unsigned long)collects,
+           (unsigned long)samples,
+           (unsigned long)seriesKeys.size(),
+           (unsigned long)store->size(),
+           (unsigned long)store->capacity());
+    printf("SeriesStore: %lu bytes, %.1f bits per sample\n",
+           (unsigned long)storeSize, 8.0 * storeSize / samples);
+    printf("TelemetryBuffer: %lu bytes at least, %.1fx more\n",
+           (unsigned long)(samples * sizeof(TelemetryRecord)),
+           (double)samples * sizeof(TelemetryRecord) / storeSize);
+    printf("Line protocol: %lu bytes, %.1fx more\n",
+           (unsigned long)lineProtocolSize, (double)lineProtocolSize / storeSize);
+
+    // Read without commit - the push failed and the data is kept - then read again in small
+    // batches, committing each one.
+    bool success = compare("read", drain(store, 1024, false), expected) &&
+        compare("read again", drain(store, 1024, false), expected) &&
+        compare("read with commits", drain(store, 300, true), expected);
+    if (success && (!store->isEmpty() || store->size() != 0)) {
+        printf("The store is not empty after the commits, %u blocks used\n", store->size());
+        success = false;
+    }
+
+    printf(success ? "Round trip OK\n" : "Round trip FAILED\n");
+    success = checkFailedPoint(store) && success;
+    return success ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+// Host test of UdpTransport against a local listener socket. The datagrams must hold whole lines
+// of up to UDP_TRANSPORT_MTU bytes, and together exactly the lines rendered by snprintf() from the
+// samples. The timestamps are in seconds, so the InfluxDB UDP listener needs precision = "s" -
+// at its default nanoseconds they would land in the first seconds of 1970.
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <string>
+
+#include "Logger.h"
+#include "TelemetryBuffer.h"
+#include "UdpTransport.h"
+
+#define SAMPLES 400
+#define START_TIME 1700000000UL
+
+static Logger logger(false);
+static TelemetryBuffer telemetry("node-1");
+static char sendBuffer[2048];
+static UdpTransport transport(&logger, sendBuffer, sizeof(sendBuffer));
+
+static const char* metrics[] = {"temperature", "humidity", "pressure"};
+
+// Fill the buffer and return the expected line protocol.
+static std::string fill() {
+    std::string expected;
+    char line[128];
+    for (uint16_t i = 0; i < SAMPLES; i++) {
+        const char* metric = metrics[i % 3];
+        float value = 20.0f + i * 0.37f;
+        uint8_t precision = i % 3;
+        uint32_t timestamp = START_TIME + i * 10;
+        telemetry.append(metric, value, precision, timestamp);
+        snprintf(line, sizeof(line), "%s,src=node-1 value=%.*f %lu\n", metric, precision, value, (unsigned long)timestamp);
+        expected += line;
+    }
+
+    TelemetryField fields[] = {{"temperature", 21.5f, 1}, {"humidity", 45.25f, 2}};
+    telemetry.appendPoint("climate", "room=kitchen", fields, 2, START_TIME + SAMPLES * 10);
+    snprintf(line, sizeof(line), "climate,src=node-1,room=kitchen temperature=21.5,humidity=45.25 %lu\n",
+             (unsigned long)(START_TIME + SAMPLES * 10));
+    expected += line;
+    return expected;
+}
+
+// The timestamps are read in seconds, each within the samples. As nanoseconds they would all fall
+// within the first 10 seconds of 1970.
+static bool checkPrecision(const std::string& received) {
+    size_t start = 0;
+    while (start < received.size()) {
+        size_t end = received.find('\n', start);
+        size_t space = received.rfind(' ', end);
+        unsigned long timestamp = strtoul(received.c_str() + space + 1, NULL, 10);
+        if (end - space - 1 != 10 || timestamp < START_TIME || timestamp > START_TIME + SAMPLES * 10) {
+            printf("Unexpected timestamp in: %s\n", received.substr(start, end - start).c_str());
+            return false;
+        }
+        if (timestamp / 1000000000UL >= 10) {
+            printf("The timestamps would be valid nanoseconds\n");
+            return false;
+        }
+        start = end + 1;
+    }
+    printf("The timestamps are in seconds, precision = \"s\" is required\n");
+    return true;
+}
+
+int main() {
+    int listener = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (bind(listener, (sockaddr*)&address, sizeof(address)) != 0 ||
+        getsockname(listener, (sockaddr*)&address, &length) != 0) {
+        perror("UDP listener");
+        return 1;
+    }
+
+    std::string expected = fill();
+    transport.setTarget(IPAddress(127, 0, 0, 1), ntohs(address.sin_port));
+    if (!transport.send(&telemetry, SIZE_MAX) || !telemetry.isEmpty()) {
+        printf("Send failed\n");
+        return 1;
+    }
+
+    std::string received;
+    uint32_t datagrams = 0;
+    char datagram[2048];
+    ssize_t size;
+    while ((size = recv(listener, datagram, sizeof(datagram), MSG_DONTWAIT)) > 0) {
+        datagrams++;
+        if (size > UDP_TRANSPORT_MTU || datagram[size - 1] != '\n') {
+            printf("Datagram %lu of %ld bytes doesn't hold whole lines within the MTU\n", (unsigned long)datagrams, (long)size);
+            return 1;
+        }
+        received.append(datagram, size);
+    }
+    close(listener);
+
+    printf("%lu bytes in %lu datagrams, %lu bytes counted\n",
+           (unsigned long)received.size(), (unsigned long)datagrams, (unsigned long)transport.stats.getBytes());
+    if (received != expected || transport.stats.getBytes() != received.size() || transport.stats.getSends() != datagrams) {
+        printf("The received line protocol doesn't match\n");
+        return 1;
+    }
+    bool success = checkPrecision(received);
+    printf(success ? "UDP line protocol OK\n" : "UDP line protocol FAILED\n");
+    return success ? 0 : 1;
+}